@@ -0,0 +1,158 @@
+#ifndef CHECKPOINT_INDEX_H
+#define CHECKPOINT_INDEX_H
+
+#include <sp2/math/vector.h>
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+//Positions of the checkpoints of a level, to find where teleporting from a checkpoint leads to.
+//Checked checkpoints are kept in a grid of cells, so a search only looks at the cells around the start.
+//Results for the four main directions are remembered per checkpoint, until the set of checked checkpoints changes.
+class CheckpointIndex
+{
+public:
+    static constexpr int none = -1;
+
+    void clear()
+    {
+        entries.clear();
+        cells.clear();
+        checked_count = 0;
+        generation++;
+    }
+
+    //Returns the slot of the checkpoint, slots are handed out in order of adding.
+    int add(sp::Vector2d position)
+    {
+        entries.push_back({position, false, {none, none, none, none}, 0});
+        return int(entries.size()) - 1;
+    }
+
+    void setChecked(int slot, bool checked)
+    {
+        auto& entry = entries[slot];
+        if (entry.checked == checked)
+            return;
+        entry.checked = checked;
+        auto& cell = cells[cellKey(cellOf(entry.position))];
+        if (checked) {
+            cell.push_back(slot);
+            if (checked_count == 0) {
+                cell_min = cell_max = cellOf(entry.position);
+            } else {
+                auto c = cellOf(entry.position);
+                cell_min = {std::min(cell_min.x, c.x), std::min(cell_min.y, c.y)};
+                cell_max = {std::max(cell_max.x, c.x), std::max(cell_max.y, c.y)};
+            }
+            checked_count++;
+        } else {
+            cell.erase(std::find(cell.begin(), cell.end(), slot));
+            checked_count--;
+        }
+        generation++;
+    }
+
+    //Checked checkpoint reached from slot when teleporting into direction, or none.
+    //The best target is within 45 degrees of direction, and has the lowest distance plus a tenth of the angle.
+    int teleportTarget(int slot, double direction)
+    {
+        double quarter = direction / 90.0;
+        if (quarter != std::floor(quarter))
+            return search(slot, direction);
+        auto& entry = entries[slot];
+        if (entry.generation != generation) {
+            entry.targets = {none, none, none, none};
+            entry.known = 0;
+            entry.generation = generation;
+        }
+        int index = ((int(quarter) % 4) + 4) % 4;
+        if (!(entry.known & (1 << index))) {
+            entry.targets[index] = search(slot, direction);
+            entry.known |= 1 << index;
+        }
+        return entry.targets[index];
+    }
+
+private:
+    static constexpr double cell_size = 16.0;
+
+    struct Entry {
+        sp::Vector2d position;
+        bool checked;
+        std::array<int, 4> targets;
+        uint8_t known;
+        uint32_t generation = 0;
+    };
+
+    static sp::Vector2i cellOf(sp::Vector2d position)
+    {
+        return {int(std::floor(position.x / cell_size)), int(std::floor(position.y / cell_size))};
+    }
+
+    static uint64_t cellKey(sp::Vector2i cell)
+    {
+        return (uint64_t(uint32_t(cell.x)) << 32) | uint64_t(uint32_t(cell.y));
+    }
+
+    static double angleBetween(double a, double b)
+    {
+        double difference = std::fmod(b - a, 360.0);
+        if (difference > 180.0) difference -= 360.0;
+        if (difference < -180.0) difference += 360.0;
+        return std::abs(difference);
+    }
+
+    //Look at rings of cells around the start, till no cell further out can hold a better target.
+    int search(int slot, double direction) const
+    {
+        if (checked_count == 0)
+            return none;
+        auto origin = entries[slot].position;
+        auto center = cellOf(origin);
+        int best = none;
+        double best_score = 100000.0 + 90 * 0.1;
+        int max_ring = std::max(std::max(std::abs(cell_min.x - center.x), std::abs(cell_max.x - center.x)), std::max(std::abs(cell_min.y - center.y), std::abs(cell_max.y - center.y)));
+        for(int ring=0; ring<=max_ring; ring++) {
+            if ((ring - 1) * cell_size > best_score)
+                break;
+            for(int y=-ring; y<=ring; y++) {
+                for(int x=-ring; x<=ring; x++) {
+                    if (std::abs(x) != ring && std::abs(y) != ring)
+                        continue;
+                    auto it = cells.find(cellKey(center + sp::Vector2i(x, y)));
+                    if (it == cells.end())
+                        continue;
+                    for(int other : it->second) {
+                        if (other == slot)
+                            continue;
+                        auto offset = entries[other].position - origin;
+                        auto angle = angleBetween(direction, offset.angle());
+                        if (angle > 45)
+                            continue;
+                        auto score = offset.length() + angle * 0.1;
+                        //Same as a scan over all checkpoints in order, where the last of equally good ones wins.
+                        if (score < best_score || (score == best_score && other > best)) {
+                            best = other;
+                            best_score = score;
+                        }
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+    std::vector<Entry> entries;
+    std::unordered_map<uint64_t, std::vector<int>> cells;
+    int checked_count = 0;
+    sp::Vector2i cell_min;
+    sp::Vector2i cell_max;
+    uint32_t generation = 1;
+};
+
+#endif//CHECKPOINT_INDEX_H
@@ -0,0 +1,321 @@
+#include "level.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/resourceProvider.h>
+#include <nlohmann/json.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+
+static constexpr char baked_magic[4] = {'O', 'D', 'L', 'V'};
+static constexpr uint32_t baked_version = 2;
+
+namespace {
+
+class BakeWriter
+{
+public:
+    template<typename T> void write(T value) { data.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+    void writeString(const sp::string& s) { write<uint16_t>(s.size()); data += s; }
+
+    std::string data;
+};
+
+class BakeReader
+{
+public:
+    BakeReader(const sp::string& data) : data(data) {}
+
+    template<typename T> T read() {
+        T value{};
+        if (offset + sizeof(T) > data.size()) { error = true; return value; }
+        memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+    //Element counts can never exceed the remaining data, which protects against huge allocations from corrupt files.
+    size_t readCount() {
+        size_t count = read<uint32_t>();
+        if (count > data.size() - std::min(offset, data.size())) { error = true; return 0; }
+        return count;
+    }
+    sp::string readString() {
+        size_t size = read<uint16_t>();
+        if (offset + size > data.size()) { error = true; return ""; }
+        sp::string result(data.data() + offset, size);
+        offset += size;
+        return result;
+    }
+
+    const sp::string& data;
+    size_t offset = 0;
+    bool error = false;
+};
+
+}
+
+sp::string LevelData::Object::getProperty(const sp::string& key) const
+{
+    auto it = properties.find(key);
+    if (it == properties.end())
+        return "";
+    return it->second;
+}
+
+const LevelData::Tile& LevelData::getTile(int index) const
+{
+    static const Tile empty_tile;
+    if (index < 0 || index >= int(tiles.size()))
+        return empty_tile;
+    return tiles[index];
+}
+
+bool LevelData::load(const sp::string& json_resource, const sp::string& baked_resource)
+{
+    auto json_stream = sp::io::ResourceProvider::get(json_resource);
+    auto baked_stream = sp::io::ResourceProvider::get(baked_resource);
+    if (baked_stream) {
+        //Without the json source we have nothing to check against, so trust the baked data.
+        if (loadBaked(baked_stream->readAll(), json_stream ? uint64_t(json_stream->getSize()) : 0))
+            return true;
+        LOG(Info, "Baked level", baked_resource, "is stale or invalid, falling back to", json_resource);
+    }
+    if (!json_stream)
+        return false;
+    return loadJson(json_stream->readAll());
+}
+
+bool LevelData::loadJson(const sp::string& data)
+{
+    tiles.clear();
+    layers.clear();
+    objects.clear();
+
+    auto json = nlohmann::json::parse(data, nullptr, false);
+    if (json.is_discarded())
+        return false;
+
+    auto& tileset = json["tilesets"][0];
+    tiles.resize(int(tileset["tilecount"]));
+    for(auto& tile_json : tileset["tiles"]) {
+        int tile_id = tile_json["id"];
+        if (tile_id < 0 || tile_id >= int(tiles.size()))
+            continue;
+        auto& tile = tiles[tile_id];
+        if (tile_json.find("properties") != tile_json.end()) {
+            for(auto& prop : tile_json["properties"]) {
+                std::string name = prop["name"];
+                if (name == "solid" && bool(prop["value"]))
+                    tile.solid = true;
+                if (name == "water" && bool(prop["value"]))
+                    tile.special = TileSpecial::Water;
+                if (name == "moss" && bool(prop["value"]))
+                    tile.special = TileSpecial::Moss;
+                if (name == "spikes") {
+                    if (std::string(prop["value"]) == "up") tile.special = TileSpecial::SpikeUp;
+                    if (std::string(prop["value"]) == "down") tile.special = TileSpecial::SpikeDown;
+                    if (std::string(prop["value"]) == "left") tile.special = TileSpecial::SpikeLeft;
+                    if (std::string(prop["value"]) == "right") tile.special = TileSpecial::SpikeRight;
+                }
+            }
+        }
+        if (tile_json.find("animation") != tile_json.end()) {
+            for(auto& anim : tile_json["animation"])
+                tile.animation.push_back({int(anim["tileid"]), int(anim["duration"])});
+        }
+    }
+
+    for(auto& layer_json : json["layers"]) {
+        if (layer_json["type"] == "tilelayer") {
+            layers.emplace_back();
+            auto& layer = layers.back();
+            layer.name = std::string(layer_json["name"]);
+            for(auto& chunk_json : layer_json["chunks"]) {
+                Chunk chunk;
+                chunk.position = {int(chunk_json["x"]), int(chunk_json["y"])};
+                chunk.size = {int(chunk_json["width"]), int(chunk_json["height"])};
+                auto& data_json = chunk_json["data"];
+                chunk.data.reserve(data_json.size());
+                for(auto& gid : data_json)
+                    chunk.data.push_back(int(gid) - 1);
+                layer.chunks.push_back(std::move(chunk));
+            }
+            if (layer_json.find("properties") != layer_json.end()) {
+                for(auto& prop : layer_json["properties"]) {
+                    std::string name = prop["name"];
+                    if (name == "autohide" && bool(prop["value"]))
+                        layer.autohide = true;
+                    if (name == "z")
+                        layer.z = int(prop["value"]);
+                }
+            }
+        }
+        if (layer_json["type"] == "objectgroup") {
+            for(auto& obj_json : layer_json["objects"]) {
+                Object obj;
+                obj.id = obj_json["id"];
+                obj.name = std::string(obj_json["name"]);
+                obj.position = {double(obj_json["x"]), double(obj_json["y"])};
+                if (obj_json.find("properties") != obj_json.end()) {
+                    for(auto& prop : obj_json["properties"]) {
+                        auto& value = prop["value"];
+                        if (value.is_string())
+                            obj.properties[std::string(prop["name"])] = std::string(value);
+                        else
+                            obj.properties[std::string(prop["name"])] = value.dump();
+                    }
+                }
+                objects.push_back(std::move(obj));
+            }
+        }
+    }
+    return true;
+}
+
+bool LevelData::loadBaked(const sp::string& data, uint64_t source_size)
+{
+    tiles.clear();
+    layers.clear();
+    objects.clear();
+
+    BakeReader reader(data);
+    if (data.size() < sizeof(baked_magic) || memcmp(data.data(), baked_magic, sizeof(baked_magic)) != 0)
+        return false;
+    reader.offset = sizeof(baked_magic);
+    if (reader.read<uint32_t>() != baked_version)
+        return false;
+    auto baked_source_size = reader.read<uint64_t>();
+    if (source_size != 0 && baked_source_size != source_size)
+        return false;
+
+    tiles.resize(reader.readCount());
+    for(auto& tile : tiles) {
+        tile.solid = reader.read<uint8_t>();
+        tile.special = TileSpecial(reader.read<uint8_t>());
+        tile.animation.resize(reader.read<uint16_t>());
+        for(auto& frame : tile.animation) {
+            frame.tile = reader.read<uint16_t>();
+            frame.duration = reader.read<uint16_t>();
+        }
+    }
+    layers.resize(reader.readCount());
+    for(auto& layer : layers) {
+        layer.name = reader.readString();
+        layer.z = reader.read<int32_t>();
+        layer.autohide = reader.read<uint8_t>();
+        layer.chunks.resize(reader.readCount());
+        for(auto& chunk : layer.chunks) {
+            chunk.position.x = reader.read<int32_t>();
+            chunk.position.y = reader.read<int32_t>();
+            chunk.size.x = reader.read<uint16_t>();
+            chunk.size.y = reader.read<uint16_t>();
+            size_t count = chunk.size.x * chunk.size.y;
+            if (reader.error || reader.offset + count * sizeof(int32_t) > data.size())
+                return false;
+            //Tiles are stored as a flat array in the same form as chunk.data, so it is copied as a single block.
+            chunk.data.resize(count);
+            memcpy(chunk.data.data(), data.data() + reader.offset, count * sizeof(int32_t));
+            reader.offset += count * sizeof(int32_t);
+        }
+    }
+    objects.resize(reader.readCount());
+    for(auto& obj : objects) {
+        obj.id = reader.read<int32_t>();
+        obj.name = reader.readString();
+        obj.position.x = reader.read<double>();
+        obj.position.y = reader.read<double>();
+        int property_count = reader.read<uint16_t>();
+        for(int n=0; n<property_count; n++) {
+            auto key = reader.readString();
+            obj.properties[key] = reader.readString();
+        }
+        if (reader.error)
+            return false;
+    }
+    return !reader.error;
+}
+
+sp::string LevelData::bake(uint64_t source_size) const
+{
+    static_assert(sizeof(int) == sizeof(int32_t), "chunk data is stored as it is in memory");
+    BakeWriter writer;
+    writer.data.append(baked_magic, sizeof(baked_magic));
+    writer.write<uint32_t>(baked_version);
+    writer.write<uint64_t>(source_size);
+
+    writer.write<uint32_t>(tiles.size());
+    for(auto& tile : tiles) {
+        writer.write<uint8_t>(tile.solid);
+        writer.write<uint8_t>(uint8_t(tile.special));
+        writer.write<uint16_t>(tile.animation.size());
+        for(auto& frame : tile.animation) {
+            writer.write<uint16_t>(frame.tile);
+            writer.write<uint16_t>(frame.duration);
+        }
+    }
+    writer.write<uint32_t>(layers.size());
+    for(auto& layer : layers) {
+        writer.writeString(layer.name);
+        writer.write<int32_t>(layer.z);
+        writer.write<uint8_t>(layer.autohide);
+        writer.write<uint32_t>(layer.chunks.size());
+        for(auto& chunk : layer.chunks) {
+            writer.write<int32_t>(chunk.position.x);
+            writer.write<int32_t>(chunk.position.y);
+            writer.write<uint16_t>(chunk.size.x);
+            writer.write<uint16_t>(chunk.size.y);
+            writer.data.append(reinterpret_cast<const char*>(chunk.data.data()), chunk.data.size() * sizeof(int32_t));
+        }
+    }
+    writer.write<uint32_t>(objects.size());
+    for(auto& obj : objects) {
+        writer.write<int32_t>(obj.id);
+        writer.writeString(obj.name);
+        writer.write<double>(obj.position.x);
+        writer.write<double>(obj.position.y);
+        writer.write<uint16_t>(obj.properties.size());
+        for(auto& it : obj.properties) {
+            writer.writeString(it.first);
+            writer.writeString(it.second);
+        }
+    }
+    return writer.data;
+}
+
+bool LevelData::bakeFile(const sp::string& json_filename, const sp::string& baked_filename)
+{
+    std::ifstream input(json_filename, std::ios::binary);
+    if (!input) {
+        LOG(Error, "Failed to open", json_filename);
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << input.rdbuf();
+    sp::string json_data = buffer.str();
+
+    LevelData level;
+    if (!level.loadJson(json_data)) {
+        LOG(Error, "Failed to parse", json_filename);
+        return false;
+    }
+    for(auto& tile : level.tiles) {
+        for(auto& frame : tile.animation) {
+            if (frame.tile < 0 || frame.tile > 0xFFFF || frame.duration < 0 || frame.duration > 0xFFFF) {
+                LOG(Error, "Tile animation out of range for baked format");
+                return false;
+            }
+        }
+    }
+
+    std::ofstream output(baked_filename, std::ios::binary);
+    auto baked = level.bake(json_data.size());
+    output.write(baked.data(), baked.size());
+    if (!output) {
+        LOG(Error, "Failed to write", baked_filename);
+        return false;
+    }
+    LOG(Info, "Baked", json_filename, "into", baked_filename, baked.size(), "bytes");
+    return true;
+}
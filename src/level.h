@@ -0,0 +1,75 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <sp2/string.h>
+#include <sp2/math/vector.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+
+//Level contents as stored in the Tiled map.json, stripped down to what createWorld() needs.
+//It can be filled from the json directly, or from a baked binary version that is much faster to load.
+class LevelData
+{
+public:
+    enum class TileSpecial : uint8_t {
+        None,
+        SpikeUp,
+        SpikeDown,
+        SpikeLeft,
+        SpikeRight,
+        Water,
+        Moss,
+    };
+    struct AnimationFrame {
+        int tile;
+        int duration; //in milliseconds
+    };
+    struct Tile {
+        bool solid = false;
+        TileSpecial special = TileSpecial::None;
+        std::vector<AnimationFrame> animation;
+    };
+    //Chunks use the Tiled coordinate system (y down), data contains the tile index, or -1 for empty.
+    struct Chunk {
+        sp::Vector2i position;
+        sp::Vector2i size;
+        std::vector<int> data;
+    };
+    struct Layer {
+        sp::string name;
+        int z = -100;
+        bool autohide = false;
+        std::vector<Chunk> chunks;
+    };
+    struct Object {
+        int id = -1;
+        sp::string name;
+        sp::Vector2d position; //in Tiled pixels
+        std::unordered_map<sp::string, sp::string> properties;
+
+        sp::string getProperty(const sp::string& key) const;
+    };
+
+    std::vector<Tile> tiles;
+    std::vector<Layer> layers;
+    std::vector<Object> objects;
+
+    const Tile& getTile(int index) const;
+
+    //Load the baked resource when it was build from the current json resource, else parse the json.
+    //The baked file is a build output, rebuilt whenever the json changes. The size of the json it was made from
+    //is stored in it as a cheap check against a stale file, so the json itself is not read when the baked file is used.
+    bool load(const sp::string& json_resource, const sp::string& baked_resource);
+
+    bool loadJson(const sp::string& data);
+    //A source_size of 0 accepts the baked data no matter what it was made from.
+    bool loadBaked(const sp::string& data, uint64_t source_size);
+    sp::string bake(uint64_t source_size) const;
+
+    //Build step, converts the json file into the baked format.
+    static bool bakeFile(const sp::string& json_filename, const sp::string& baked_filename);
+};
+
+#endif//LEVEL_H
@@ -35,7 +35,29 @@
 #include <sp2/io/filesystem.h>
 #include <nlohmann/json.hpp>
 #include <optional>
-
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "level.h"
+#include "tileFlags.h"
+#include "solidRegions.h"
+#include "replay.h"
+#include "validator.h"
+#include "saveStore.h"
+#include "snapshot.h"
+#include "spriteAtlas.h"
+#include "spriteBatch.h"
+#include "nodePool.h"
+#include "checkpointIndex.h"
+#include "triggerGrid.h"
+#include "tickScheduler.h"
+#include "profiler.h"
+
+
+//Headless mode simulates the game without window, audio or GUI, as fast as the CPU allows, or at game_speed times realtime with --speed.
+bool headless = false;
+float game_speed = 1.0f;
 
 class SaveProgressInterface {
 public:
@@ -43,52 +65,218 @@ public:
     virtual void load(nlohmann::json& json) = 0;
 };
 
-void saveGame()
-{
-    nlohmann::json json;
-    for(auto node : sp::Scene::get("MAIN")->getRoot()->getChildren()) {
-        auto spi = dynamic_cast<SaveProgressInterface*>(*node);
-        if (spi) spi->save(json);
-    }
-    sp::io::saveFileContents(sp::io::preferencePath() + "progress.save", json.dump());
-}
+SaveStore progress_store;
+SpriteAtlas sprite_atlas;
+NodePoolStats node_pool_stats;
+Profiler profiler;
+
+//When set, solid tiles of the MAIN layer get merged rectangle collision instead of per tile collision.
+bool merged_tile_collision = false;
+
+sp::io::Keybinding up_binding{"UP", {"up", "keypad 8", "w", "gamecontroller:0:button:dpup", "gamecontroller:0:axis:lefty"}};
+sp::io::Keybinding down_binding{"DOWN", {"down", "keypad 2", "s", "gamecontroller:0:button:dpdown"}};
+sp::io::Keybinding left_binding{"LEFT", {"left", "keypad 4", "a", "gamecontroller:0:button:dpleft"}};
+sp::io::Keybinding right_binding{"RIGHT", {"right", "keypad 6", "d", "gamecontroller:0:button:dpright", "gamecontroller:0:axis:leftx"}};
+
+sp::io::Keybinding jump_binding{"JUMP", {"space", "z", "gamecontroller:0:button:a"}};
+sp::io::Keybinding menu_binding{"MENU", {"escape", "gamecontroller:0:button:start"}};
+sp::io::Keybinding rewind_binding{"REWIND", {"r", "gamecontroller:0:button:back"}};
+//Shows or hides the profiler overlay, not part of the gameplay input.
+sp::io::Keybinding profiler_binding{"PROFILER", {"f3"}};
 
-void createWorld();
+//Practice mode never writes the saved progress, and allows rewinding to the last touched checkpoint.
+bool practice_mode = false;
 
-sp::P<sp::Camera> camera;
-sp::Vector2d start_position;
-sp::Vector2d plane_start_position;
 enum class IntroState {
     WaitForInitialStart,
     CrashingDown,
     Crashed,
     Done,
 };
-IntroState intro_state = IntroState::WaitForInitialStart;
 
-sp::P<sp::gui::Widget> visible_message;
-std::function<void()> post_message_function;
+enum class InputMode {
+    Live,
+    Record,
+    Playback,
+};
+
+class Player;
+class WorldStreamer;
+class WorldNode;
+class FadeOutNode;
+class Checkpoint;
+class LayerFader;
+
+//Everything that makes up a single running game. A world is its own scene, with its own nodes and physics,
+//so several worlds can exist next to each other and be stepped independently.
+//Gameplay nodes find the world they are part of through their scene, see WorldNode.
+class World : public sp::Scene
+{
+public:
+    World(const sp::string& name, bool interactive, InputMode input_mode);
+    ~World();
+
+    //Level data as create() uses it, logs and returns nullptr when it cannot be loaded.
+    static std::shared_ptr<const LevelData> loadLevel();
+    //Build the level and place the player, from the saved progress if there is any.
+    //Without level data the level is loaded from disk, worlds simulating the same level can share it.
+    void create(std::shared_ptr<const LevelData> level = nullptr);
+    //Start over with a new game. The level that create() built is kept, only what changed during play is thrown away.
+    void reset(InputMode input_mode);
+
+    void saveGame();
+    void saveProgress(nlohmann::json& json);
+    void loadProgress(nlohmann::json& json);
+    template<typename T> void registerSaveProgress(T* participant) { save_participants.push_back({participant, participant}); }
+
+    //Copy the state of everything that changes during play, only possible after the intro and while no message is shown.
+    bool snapshot(WorldSnapshot& snapshot);
+    void restore(const WorldSnapshot& snapshot);
+    //Nodes with a snapshot key take part in snapshots, the key identifies them in the level, usually their object id.
+    void registerSnapshot(sp::P<WorldNode> node, uint32_t key);
+    static constexpr uint32_t player_snapshot_key = 0;
+    //Checkpoints are registered once their position and id are set, the index finds teleport targets between them.
+    void registerCheckpoint(sp::P<Checkpoint> checkpoint);
+    sp::P<Checkpoint> findCheckpoint(int id);
+    sp::P<Checkpoint> getCheckpoint(int slot);
+    CheckpointIndex checkpoint_index;
+    //Areas that react to the player, updated each fixed tick by the TriggerTicker.
+    TriggerGrid trigger_grid;
+    //Nodes that are idle most of the time get their updates through this, run by the SchedulerTicker.
+    TickScheduler tick_scheduler;
+    void showMessage(sp::string message, std::function<void()> func={});
+    void hideMessage();
+    bool messageDismissRequested();
+    void playSound(const sp::string& name);
+    void playMusic(const sp::string& name);
+    sp::P<sp::gui::Widget> loadGui(const sp::string& filename, const sp::string& name);
+    void streamAround(sp::Vector2d position);
+
+    //Only an interactive world plays audio, shows GUI, saves progress and pauses the engine for messages.
+    //Other worlds are pure simulations, like the headless runs.
+    bool interactive;
+
+    sp::P<sp::Camera> camera;
+    sp::P<Player> player;
+    sp::P<WorldStreamer> world_streamer;
+    sp::P<LayerFader> layer_fader;
+    sp::Vector2d start_position;
+    sp::Vector2d plane_start_position;
+    IntroState intro_state = IntroState::WaitForInitialStart;
+
+    bool message_visible = false;
+    sp::P<sp::gui::Widget> visible_message;
+    std::function<void()> post_message_function;
+
+    TileFlagGrid tile_flags;
+    std::unordered_map<sp::string, sp::P<sp::Tilemap>> tilemap_by_name;
+    std::unordered_map<sp::string, sp::Vector2d> secret_target;
+
+    //Gameplay only reads input through these, which hold the state of the current fixed tick.
+    InputButton key_up{up_binding};
+    InputButton key_down{down_binding};
+    InputButton key_left{left_binding};
+    InputButton key_right{right_binding};
+    InputButton key_jump{jump_binding};
+    InputButton key_menu{menu_binding};
+    InputButton key_rewind{rewind_binding};
+    InputButton* const input_buttons[InputReplay::button_count] = {&key_up, &key_down, &key_left, &key_right, &key_jump, &key_menu, &key_rewind};
+
+    InputMode input_mode;
+    InputReplay input_replay;
+    int simulation_tick = 0;
+    sp::string reached_ending;
+
+    //Taken when touching a checkpoint in practice mode, the rewind key returns here.
+    WorldSnapshot practice_snapshot;
+
+    //Short lived effect nodes are recycled through these.
+    NodePool<PooledNode> rope_segment_pool;
+    NodePool<PooledNode> arrow_pool;
+    NodePool<FadeOutNode> fade_out_pool;
+
+private:
+    //Everything with progress to save, in order of creation, so saving and loading do not have to go over all nodes.
+    //Entries of destroyed nodes are dropped on the next save or load.
+    struct SaveParticipant {
+        sp::P<sp::Node> node;
+        SaveProgressInterface* progress;
+    };
+    std::vector<SaveParticipant> save_participants;
+
+    struct SnapshotParticipant {
+        uint32_t key;
+        sp::P<WorldNode> node;
+    };
+    std::vector<SnapshotParticipant> snapshot_participants;
+
+    //In order of their slot in checkpoint_index.
+    std::vector<sp::P<Checkpoint>> checkpoints;
 
-sp::InfiniGrid<bool> watermap{false};
-sp::InfiniGrid<bool> mossmap{false};
-std::unordered_map<sp::string, sp::P<sp::Tilemap>> tilemap_by_name;
-std::unordered_map<sp::string, sp::Vector2d> secret_target;
+    void removeDestroyedSaveParticipants();
+    void removeDestroyedSnapshotParticipants();
+    void buildLayers(const LevelData& level);
+    void placeObjects(const LevelData& level);
+    void start();
 
-sp::io::Keybinding key_up{"UP", {"up", "keypad 8", "w", "gamecontroller:0:button:dpup", "gamecontroller:0:axis:lefty"}};
-sp::io::Keybinding key_down{"DOWN", {"down", "keypad 2", "s", "gamecontroller:0:button:dpdown"}};
-sp::io::Keybinding key_left{"LEFT", {"left", "keypad 4", "a", "gamecontroller:0:button:dpleft"}};
-sp::io::Keybinding key_right{"RIGHT", {"right", "keypad 6", "d", "gamecontroller:0:button:dpright", "gamecontroller:0:axis:leftx"}};
+    //Nodes that make up the level itself, everything else in the root is created during play.
+    sp::PList<sp::Node> level_nodes;
+    sp::Vector2d initial_plane_start_position;
+    bool quickstart = false;
+};
+
+//Base of all nodes that take part in the gameplay, so they have access to their world.
+class WorldNode : public sp::Node
+{
+public:
+    WorldNode(sp::P<sp::Node> parent)
+    : sp::Node(parent), world(getScene())
+    {
+    }
 
-sp::io::Keybinding key_jump{"JUMP", {"space", "z", "gamecontroller:0:button:a"}};
-sp::io::Keybinding key_menu{"MENU", {"escape", "gamecontroller:0:button:start"}};
+    //Nodes registered with World::registerSnapshot store and restore their dynamic state with these.
+    virtual void snapshot(SnapshotWriter& writer) {}
+    virtual void restore(SnapshotReader& reader) {}
+    //Level nodes that are kept by World::reset return to their state at the start of a new game.
+    virtual void restart() {}
+
+    sp::P<World> world;
+};
 
-void showMessage(sp::string message, std::function<void()> func={})
+//Samples the input for each fixed tick, before any of the gameplay nodes run, as it is the first node in the world.
+class InputTicker : public WorldNode
 {
-    visible_message = sp::gui::Loader::load("gui/msgbox.gui", "MSGBOX");
-    visible_message->getWidgetWithID("MSG")->setAttribute("caption", message);
-    sp::Engine::getInstance()->setGameSpeed(0.0);
-    post_message_function = func;
-}
+public:
+    InputTicker(sp::P<sp::Node> parent)
+    : WorldNode(parent)
+    {
+    }
+
+    void onFixedUpdate() override
+    {
+        //Ticks that still happen in the same frame after a message paused the game are not part of the simulation,
+        //gameplay ignores them, so they are not counted or recorded either.
+        if (world->message_visible) {
+            for(auto button : world->input_buttons)
+                button->state = {};
+            return;
+        }
+        if (world->input_mode == InputMode::Playback) {
+            const auto& frame = world->input_replay.playback();
+            for(int n=0; n<InputReplay::button_count; n++)
+                world->input_buttons[n]->state = frame[n];
+        } else {
+            InputReplay::Frame frame;
+            for(int n=0; n<InputReplay::button_count; n++) {
+                world->input_buttons[n]->capture();
+                frame[n] = world->input_buttons[n]->state;
+            }
+            if (world->input_mode == InputMode::Record)
+                world->input_replay.record(frame);
+        }
+        world->simulation_tick++;
+    }
+};
 
 class FadeLabel : public sp::gui::Label
 {
@@ -201,13 +389,14 @@ std::optional<sp::Vector2d> traceCollision(const sp::Ray2d& ray)
 }
 */
 
-class Checkpoint : public sp::Node, public SaveProgressInterface
+class Checkpoint : public WorldNode, public SaveProgressInterface
 {
 public:
     Checkpoint(sp::P<sp::Node> parent)
-    : sp::Node(parent)
+    : WorldNode(parent)
     {
-        setAnimation(sp::SpriteAnimation::load("flag.txt"));
+        world->registerSaveProgress(this);
+        setAnimation(sprite_atlas.loadAnimation("flag.txt"));
         animationPlay("Idle");
 
         sp::collision::Box2D shape{0.5, 0.5};
@@ -217,75 +406,102 @@ public:
 
     void activate()
     {
-        if (!is_checked) sp::audio::Sound::play("sfx/checkpoint.wav");
-        is_checked = true;
+        if (!is_checked) world->playSound("sfx/checkpoint.wav");
+        setChecked(true);
         animationPlay("Active");
     }
 
     void check()
     {
-        if (!is_checked) sp::audio::Sound::play("sfx/checkpoint.wav");
-        is_checked = true;
+        if (!is_checked) world->playSound("sfx/checkpoint.wav");
+        setChecked(true);
         animationPlay("Found");
     }
 
     sp::P<Checkpoint> teleport(double direction) {
-        sp::P<Checkpoint> best_checkpoint;
-        double best_distance = 100000.0;
-        double best_angle = 90;
-        for(auto node : getParent()->getChildren()) {
-            sp::P<Checkpoint> checkpoint = node;
-            if (checkpoint && checkpoint != this && checkpoint->is_checked) {
-                auto offset = checkpoint->getPosition2D() - getPosition2D();
-                auto distance = offset.length();
-                auto angle = std::abs(sp::angleDifference(direction, offset.angle()));
-                if (angle > 45) continue;
-                if (distance + angle * 0.1 > best_distance + best_angle * 0.1) continue;
-                best_checkpoint = checkpoint;
-                best_distance = distance;
-                best_angle = angle;
-            }
-        }
-        return best_checkpoint;
+        return world->getCheckpoint(world->checkpoint_index.teleportTarget(slot, direction));
     }
 
     bool is_checked = false;
     int id = -1;
+    //Position in World::checkpoint_index, set by World::registerCheckpoint.
+    int slot = CheckpointIndex::none;
 
     void save(nlohmann::json& json) override {
         if (is_checked) json["checkpoint_" + std::to_string(id)] = true;
     }
     void load(nlohmann::json& json) override {
         auto it = json.find("checkpoint_" + std::to_string(id));
-        if (it != json.end()) is_checked = *it;
+        if (it != json.end()) setChecked(*it);
         if (is_checked) check();
     }
+
+    void snapshot(SnapshotWriter& writer) override {
+        writer.write(is_checked);
+    }
+    void restore(SnapshotReader& reader) override {
+        setChecked(reader.read<bool>());
+        animationPlay(is_checked ? "Found" : "Idle");
+    }
+    void restart() override {
+        setChecked(false);
+        animationPlay("Idle");
+    }
+
+private:
+    void setChecked(bool checked) {
+        is_checked = checked;
+        if (slot != CheckpointIndex::none)
+            world->checkpoint_index.setChecked(slot, checked);
+    }
+};
+
+//Static collision for a rectangle of solid tiles, replaces the per tile collision of the MAIN tilemap
+//when merged_tile_collision is enabled.
+class SolidArea : public sp::Node
+{
+public:
+    SolidArea(sp::P<sp::Node> parent, sp::Rect2i area)
+    : sp::Node(parent)
+    {
+        setPosition(sp::Vector2d(area.position) + sp::Vector2d(area.size) * 0.5);
+        sp::collision::Box2D shape{double(area.size.x), double(area.size.y)};
+        shape.type = sp::collision::Shape::Type::Static;
+        setCollisionShape(shape);
+    }
 };
 
-class FadeOutNode : public sp::Node
+class FadeOutNode : public PooledNode
 {
 public:
     FadeOutNode(sp::P<sp::Node> parent)
-    : sp::Node(parent) {
+    : PooledNode(parent) {
+    }
+
+    void onAcquire() override {
+        render_data.color.a = 1.0;
         timer.start(0.5);
     }
 
     void onUpdate(float delta) override {
+        if (isInPool()) return;
         render_data.color.a = 1.0 - timer.getProgress();
         if (timer.isExpired())
-            delete this;
+            sp::P<World>(getScene())->fade_out_pool.release(this);
     }
 
     sp::Timer timer;
 };
 
-class Player : public sp::Node, public SaveProgressInterface
+class Player : public WorldNode, public SaveProgressInterface
 {
 public:
     Player(sp::P<sp::Node> parent)
-    : sp::Node(parent)
+    : WorldNode(parent)
     {
-        setAnimation(sp::SpriteAnimation::load("player.txt"));
+        world->registerSaveProgress(this);
+        world->registerSnapshot(this, World::player_snapshot_key);
+        setAnimation(sprite_atlas.loadAnimation("player.txt"));
         animationPlay("Idle");
 
         sp::collision::Box2D shape{0.4, 0.8};
@@ -296,55 +512,80 @@ public:
         death_line = new sp::Node(getParent());
         death_line->render_data.shader = sp::Shader::get("internal:basic.shader");
         sp::MeshBuilder mb;
+        auto uv = sprite_atlas.getUVRect("danger-line.png");
+        sp::Vector2f uv0{uv.position.x, uv.position.y + uv.size.y};
+        sp::Vector2f uv1{uv.position.x + uv.size.x, uv.position.y};
         for(int n=-30; n<30; n++)
-            mb.addQuad({n - 0.5f, -0.5f, 0}, {n + 0.5f, -0.5f, 0}, {n - 0.5f, 0.5f, 0}, {n + 0.5f, 0.5f, 0});
+            mb.addQuad({n - 0.5f, -0.5f, 0}, {n + 0.5f, -0.5f, 0}, {n - 0.5f, 0.5f, 0}, {n + 0.5f, 0.5f, 0}, uv0, {uv1.x, uv0.y}, {uv0.x, uv1.y}, uv1);
         death_line->render_data.mesh = mb.create();
-        death_line->render_data.texture = sp::texture_manager.get("danger-line.png");
+        death_line->render_data.texture = sprite_atlas.getTexture("danger-line.png");
         death_line->render_data.order = 1000;
         death_line->setPosition(sp::Vector2d(0, -10000));
     }
 
     void onUpdate(float delta) override
     {
-        if (camera_shake.isExpired() || camera_shake.isRunning()) {
-            camera->setPosition(camera->getPosition2D() + sp::Vector2d(sp::random(-0.1, 0.1), sp::random(-0.1, 0.1)));
+        //Worlds without a window have no view to follow, and a headless frame can span many ticks.
+        if (world->interactive && (camera_shake.isExpired() || camera_shake.isRunning())) {
+            world->camera->setPosition(world->camera->getPosition2D() + sp::Vector2d(sp::random(-0.1, 0.1), sp::random(-0.1, 0.1)));
         }
 
-        if (visible_message) {
-            if (key_jump.getDown()) {
+        if (world->message_visible) {
+            if (world->messageDismissRequested()) {
                 if (state == State::Walking) state = State::Falling;
-                visible_message.destroy();
-                sp::Engine::getInstance()->setGameSpeed(1.0f);
-                if (post_message_function) {
-                    auto f = post_message_function;
+                world->hideMessage();
+                if (world->post_message_function) {
+                    auto f = world->post_message_function;
                     f();
                 }
             }
             return;
         }
-        if (first_death_timer.isExpired()) {
-            showMessage("Wow, I should be more careful.", [](){
-                showMessage("Falling beyond a certain\ndistance could be painful");
-            });
-        }
 
         auto target_y = death_height - 0.9;
         auto delta_y = target_y - death_line->getPosition2D().y;
         death_line->setPosition({std::floor(getPosition2D().x), death_line->getPosition2D().y + delta_y * 0.1});
 
-        if (state == State::Death) return;
+        if (state == State::Death || !world->interactive) return;
         auto pos = getPosition2D();
-        auto camera_pos = camera->getPosition2D();
+        auto camera_pos = world->camera->getPosition2D();
         camera_pos.x = pos.x;
         if (camera_pos.y > pos.y || state == State::Walking || state == State::Hanging || state == State::ClimbUp || state == State::Teleport || (state == State::Swimming && getLinearVelocity2D().y > -3)) {
             auto y_delta = pos.y - camera_pos.y;
-            camera_pos.y += y_delta * delta * 3.0;
+            camera_pos.y += y_delta * std::min(1.0, delta * 3.0);
         }
-        camera->setPosition(camera_pos);
+        world->camera->setPosition(camera_pos);
     }
 
     void onFixedUpdate() override
     {
+        ProfileZone zone("Player::onFixedUpdate");
+        //Keep still during ticks that run after a message paused the game, and continue with the same velocity after.
+        if (world->message_visible) {
+            if (!frozen) {
+                frozen = true;
+                frozen_velocity = getLinearVelocity2D();
+            }
+            setLinearVelocity({0, 0});
+            return;
+        }
+        if (frozen) {
+            frozen = false;
+            setLinearVelocity(frozen_velocity);
+        }
+        if (first_death_delay > 0) {
+            first_death_delay--;
+            if (first_death_delay == 0) {
+                world->showMessage("Wow, I should be more careful.", [world=world]() {
+                    world->showMessage("Falling beyond a certain\ndistance could be painful");
+                });
+            }
+        }
+        if (practice_mode && world->key_rewind.getDown() && !world->practice_snapshot.empty()) {
+            world->restore(world->practice_snapshot);
+            return;
+        }
+
         auto jump_velocity = 9.0;
         auto gravity = 20.0;
         auto jump_gravity = 15.0;
@@ -354,9 +595,10 @@ public:
         auto velocity = getLinearVelocity2D();
 
         bool old_in_water = in_water;
-        in_water = watermap.get({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.25))});
+        in_water = world->tile_flags.has({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.25))}, TileFlagGrid::Water);
         if (in_water != old_in_water && in_water) {
-            sp::audio::Sound::play("sfx/water.wav");
+            world->playSound("sfx/water.wav");
+            ProfileZone particles_zone("particle spawn");
             auto pe = new sp::ParticleEmitter(getParent(), "splash.particles.txt");
             pe->setPosition(getPosition2D() + sp::Vector2d(0, -0.2));
         }
@@ -364,7 +606,7 @@ public:
         if (state == State::Jumping) {
             if (velocity.y <= jump_max_v)
                 state = State::Falling;
-            if (!key_jump.get()) {
+            if (!world->key_jump.get()) {
                 velocity.y *= 0.3;
                 state = State::Falling;
             }
@@ -402,10 +644,10 @@ public:
             break;
         case State::Swimming:
             velocity.y *= 0.9;
-            if (watermap.get({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.35))})) {
+            if (world->tile_flags.has({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.35))}, TileFlagGrid::Water)) {
                 velocity.y += 10.0 * sp::Engine::fixed_update_delta;
                 if (can_dive) {
-                    auto request = key_up.getValue() - key_down.getValue();
+                    auto request = world->key_up.getValue() - world->key_down.getValue();
                     velocity.y += request * 20.0 * sp::Engine::fixed_update_delta;
                     if (std::abs(velocity.y) < 3)
                         updateFallDepth();
@@ -413,7 +655,7 @@ public:
             } else {
                 velocity.y -= 0.1 * sp::Engine::fixed_update_delta;
                 if (can_dive) {
-                    auto request = -key_down.getValue();
+                    auto request = -world->key_down.getValue();
                     velocity.y += request * 20.0 * sp::Engine::fixed_update_delta;
                 }
                 updateFallDepth();
@@ -433,7 +675,7 @@ public:
         } else if (state == State::Hanging || state == State::ClimbUp) {
             velocity.x = 0.0;
         } else if (state == State::Swinging) {
-            auto request = key_right.getValue() - key_left.getValue();
+            auto request = world->key_right.getValue() - world->key_left.getValue();
             velocity.x *= 0.97;
             velocity.x += request * 0.2;
             int index = 0;
@@ -442,7 +684,7 @@ public:
                 index++;
             }
         } else if (state != State::Death) {
-            auto target_velocity = (key_right.getValue() - key_left.getValue()) * move_speed;
+            auto target_velocity = (world->key_right.getValue() - world->key_left.getValue()) * move_speed;
             auto delta = target_velocity - velocity.x;
             if (std::abs(delta) <= move_speed) {
                 velocity.x = target_velocity;
@@ -450,20 +692,20 @@ public:
                 velocity.x += std::copysign(move_speed, delta) * 0.3;
             }
         }
-        if (key_jump.getDown()) {
+        if (world->key_jump.getDown()) {
             if (state == State::Walking || state == State::Falling) {
                 jump_buffer = 4;
             }
-            if (state == State::Swimming && !watermap.get({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.4))})) {
+            if (state == State::Swimming && !world->tile_flags.has({int(std::floor(getPosition2D().x)), int(std::floor(getPosition2D().y + 0.4))}, TileFlagGrid::Water)) {
                 velocity.y += jump_velocity;
                 state = State::Jumping;
                 jump_count += 1;
             }
             if (state == State::Hanging) {
-                if ((key_left.get() && (animationGetFlags() & sp::SpriteAnimation::FlipFlag)) || (key_right.get() && !(animationGetFlags() & sp::SpriteAnimation::FlipFlag))) {
+                if ((world->key_left.get() && (animationGetFlags() & sp::SpriteAnimation::FlipFlag)) || (world->key_right.get() && !(animationGetFlags() & sp::SpriteAnimation::FlipFlag))) {
                     state = State::ClimbUp;
                 } else {
-                    sp::audio::Sound::play("sfx/blip.wav");
+                    world->playSound("sfx/blip.wav");
                     double wall_jump_angle = 40.0;
                     velocity.y += jump_velocity * std::sin(wall_jump_angle / 180.0 * sp::pi);
                     velocity.x = -inFaceDir(jump_velocity * std::cos(wall_jump_angle / 180.0 * sp::pi));
@@ -474,8 +716,7 @@ public:
             }
             if (state == State::Teleport) {
                 state = State::Falling;
-                for(auto n : teleport_arrows)
-                    n.destroy();
+                removeTeleArrows();
             } else if (state == State::Falling && aboveDeathLine(-1.0) && can_rope) {
                 rope_attachpoint = getPosition2D() + sp::Vector2d(inFaceDir(2.5), 2.5);
                 if (!tryToRope(rope_attachpoint)) {
@@ -485,33 +726,31 @@ public:
 
                 if (!rope_joint) {
                     for(int n=0; n<5; n++) {
-                        auto rn = new FadeOutNode(getParent());
+                        auto rn = world->fade_out_pool.acquire(getParent());
                         rn->render_data.shader = sp::Shader::get("internal:color.shader");
-                        rn->render_data.mesh = sp::MeshData::createQuad({0.1, 0.1});
+                        rn->render_data.mesh = getQuadMesh({0.1, 0.1});
                         rn->render_data.type = sp::RenderData::Type::Normal;
                         rn->setPosition(sp::Tween<sp::Vector2d>::linear(0.2f + 0.2f * n, 0.0f, 1.0f, getPosition2D(), rope_attachpoint));
                     }
                 }
             }
         }
-        if (key_jump.getUp() && state == State::Swinging) {
-            for(auto n : rope_nodes)
-                n.destroy();
-            rope_joint.destroy();
+        if (world->key_jump.getUp() && state == State::Swinging) {
+            removeRope();
             state = State::Falling;
         }
         if (jump_buffer) {
             if (state == State::Walking) {
                 velocity.y += jump_velocity;
                 state = State::Jumping;
-                sp::audio::Sound::play("sfx/blip.wav");
+                world->playSound("sfx/blip.wav");
                 jump_buffer = 0;
                 jump_count += 1;
             } else {
                 jump_buffer--;
             }
         }
-        if (key_up.getDown()) {
+        if (world->key_up.getDown()) {
             if (state == State::Hanging) {
                 state = State::ClimbUp;
             } else if (state == State::Walking) {
@@ -526,7 +765,7 @@ public:
                 teleport(90);
             }
         }
-        if (key_down.getDown()) {
+        if (world->key_down.getDown()) {
             if (state == State::Hanging) {
                 setPosition(getPosition2D() - sp::Vector2d(0, 0.1));
                 state = State::Falling;
@@ -534,11 +773,11 @@ public:
             if (state == State::Teleport)
                 teleport(-90);
         }
-        if (key_left.getDown()) {
+        if (world->key_left.getDown()) {
             if (state == State::Teleport)
                 teleport(180);
         }
-        if (key_right.getDown()) {
+        if (world->key_right.getDown()) {
             if (state == State::Teleport)
                 teleport(0);
         }
@@ -550,7 +789,7 @@ public:
                 respawn();
             }
         } else if (getPosition2D().y < death_height - 6.0) {
-            sp::audio::Sound::play("sfx/death.wav");
+            world->playSound("sfx/death.wav");
             state = State::Death;
             respawn_delay = 30;
             camera_shake.start(0.3);
@@ -586,20 +825,21 @@ public:
         } else {
             animationPlay("Idle");
         }
-        if (key_menu.getDown()) {
-            auto gui = sp::gui::Loader::load("gui/ingame.gui", "MENU");
+        if (world->key_menu.getDown() && world->interactive) {
+            auto gui = world->loadGui("gui/ingame.gui", "MENU");
             gui->getWidgetWithID("RESUME")->setEventCallback([=](sp::Variant) mutable {
                 gui.destroy();
                 sp::Engine::getInstance()->setPause(false);
             });
-            gui->getWidgetWithID("RESET")->setEventCallback([=](sp::Variant) mutable {
+            gui->getWidgetWithID("RESET")->setEventCallback([gui, world=world](sp::Variant) mutable {
                 gui.destroy();
                 sp::audio::Music::stop();
                 sp::Engine::getInstance()->setPause(false);
-                sp::io::saveFileContents(sp::io::preferencePath() + "progress.save", "");
-                sp::Scene::get("MAIN").destroy();
-                intro_state = IntroState::WaitForInitialStart;
-                createWorld();
+                //Practice runs never touch the saved progress, see World::saveGame.
+                if (!practice_mode)
+                    progress_store.clear();
+                //A recording always starts with a fresh world, so start over. A replay cannot continue after a reset.
+                world->reset(world->input_mode == InputMode::Record ? InputMode::Record : InputMode::Live);
             });
             gui->getWidgetWithID("QUIT")->setEventCallback([](sp::Variant) {
                 sp::Engine::getInstance()->shutdown();
@@ -612,21 +852,15 @@ public:
     }
 
     bool tryToRope(sp::Vector2d target) {
+        ProfileZone zone("collision query");
         getScene()->queryCollisionAll({getPosition2D(), target}, [&](sp::P<sp::Node> node, sp::Vector2d hit_location, sp::Vector2d hit_normal) {
             if (node->isSolid()) {
                 rope_attachpoint = hit_location;
-                if (sp::P<sp::Tilemap>(node) && hit_normal.y < -0.5 && mossmap.get({int(std::floor(hit_location.x)), int(std::floor(hit_location.y))})) {
+                bool tile_collision = sp::P<sp::Tilemap>(node) || sp::P<SolidArea>(node);
+                if (tile_collision && hit_normal.y < -0.5 && world->tile_flags.has({int(std::floor(hit_location.x)), int(std::floor(hit_location.y))}, TileFlagGrid::Moss)) {
                     state = State::Swinging;
-                    sp::audio::Sound::play("sfx/rope.wav");
-                    rope_joint = new sp::collision::RopeJoint2D(this, {0, 0}, node, hit_location, (getPosition2D() - hit_location).length());
-                    for(int n=0; n<5; n++) {
-                        auto rn = new sp::Node(getParent());
-                        rn->render_data.shader = sp::Shader::get("internal:color.shader");
-                        rn->render_data.mesh = sp::MeshData::createQuad({0.1, 0.1});
-                        rn->render_data.type = sp::RenderData::Type::Normal;
-                        rn->setPosition(sp::Tween<sp::Vector2d>::linear(0.2f + 0.2f * n, 0.0f, 1.0f, getPosition2D(), hit_location));
-                        rope_nodes.add(rn);
-                    }
+                    world->playSound("sfx/rope.wav");
+                    attachRope(node, hit_location, (getPosition2D() - hit_location).length());
                 }
                 return false;
             }
@@ -635,8 +869,29 @@ public:
         return rope_joint != nullptr;
     }
 
+    void attachRope(sp::P<sp::Node> node, sp::Vector2d attach_point, double length) {
+        rope_length = length;
+        rope_joint = new sp::collision::RopeJoint2D(this, {0, 0}, node, attach_point, length);
+        for(int n=0; n<5; n++) {
+            auto rn = world->rope_segment_pool.acquire(getParent());
+            rn->render_data.shader = sp::Shader::get("internal:color.shader");
+            rn->render_data.mesh = getQuadMesh({0.1, 0.1});
+            rn->render_data.type = sp::RenderData::Type::Normal;
+            rn->setPosition(sp::Tween<sp::Vector2d>::linear(0.2f + 0.2f * n, 0.0f, 1.0f, getPosition2D(), attach_point));
+            rope_nodes.add(rn);
+        }
+    }
+
+    void removeRope() {
+        for(auto n : rope_nodes)
+            world->rope_segment_pool.release(n);
+        rope_nodes.clear();
+        rope_joint.destroy();
+    }
+
     void onCollision(sp::CollisionInfo& info) override
     {
+        if (world->message_visible) return;
         sp::P<Checkpoint> cp = info.other;
         if (cp && (state == State::Walking || state == State::Swimming) && cp != checkpoint) {
             setCheckpoint(cp);
@@ -648,9 +903,7 @@ public:
                 } else if (state != State::Death && state != State::Teleport && state != State::Jumping) {
                     updateFallDepth();
                     state = State::Walking;
-                    for(auto n : rope_nodes)
-                        n.destroy();
-                    rope_joint.destroy();
+                    removeRope();
                     to_fall_state_delay = coyote_time;
                 }
             } else if (info.normal.y > 0.5) { // Hit ceiling
@@ -663,9 +916,7 @@ public:
                         auto vertical_hit = checkCollisionVertical({std::copysign(1, info.normal.x), 0.4});
                         if (vertical_hit) {
                             state = State::Hanging;
-                            for(auto n : rope_nodes)
-                                n.destroy();
-                            rope_joint.destroy();
+                            removeRope();
                             setLinearVelocity(sp::Vector2d(0, 0));
                             setPosition({getPosition2D().x, vertical_hit.value().y - 0.3});
                             animationSetFlags((info.normal.x < 0) ? sp::SpriteAnimation::FlipFlag : 0);
@@ -682,29 +933,29 @@ public:
             auto target = checkpoint->teleport(direction);
             if (target) {
                 setCheckpoint(target);
+                world->streamAround(target->getPosition2D());
                 setPosition(target->getPosition2D() + sp::Vector2d(0, 0.7));
                 updateFallDepth();
-                sp::audio::Sound::play("sfx/tele.wav");
+                world->playSound("sfx/tele.wav");
                 buildTeleArrows();
             }
         }
     }
 
     void buildTeleArrows() {
-        for(auto n : teleport_arrows)
-            n.destroy();
+        removeTeleArrows();
         if (checkpoint) {
             for(double dir : {0.0, 90.0, 180.0, 270.0}) {
                 if (auto target = checkpoint->teleport(dir)) {
                     auto target_dir = (target->getPosition2D() - checkpoint->getPosition2D()).angle();
                     dir += sp::angleDifference(dir, target_dir) * 0.7;
-                    auto n = new sp::Node(this);
+                    auto n = world->arrow_pool.acquire(this);
                     n->setPosition(sp::Vector2d(0.5, 0).rotate(dir));
                     n->setRotation(dir + 180.0);
                     n->render_data.shader = sp::Shader::get("internal:basic.shader");
-                    n->render_data.mesh = sp::MeshData::createQuad({1, 1});
+                    n->render_data.mesh = sprite_atlas.getQuad("arrow.png", {1, 1});
                     n->render_data.type = sp::RenderData::Type::Normal;
-                    n->render_data.texture = sp::texture_manager.get("arrow.png");
+                    n->render_data.texture = sprite_atlas.getTexture("arrow.png");
                     n->render_data.order = 1000;
                     teleport_arrows.add(n);
                 }
@@ -712,26 +963,33 @@ public:
         }
     }
 
+    void removeTeleArrows() {
+        for(auto n : teleport_arrows)
+            world->arrow_pool.release(n);
+        teleport_arrows.clear();
+    }
+
     void setCheckpoint(sp::P<Checkpoint> cp) {
         if (cp == checkpoint) return;
         if (checkpoint)
             checkpoint->check();
         checkpoint = cp;
         checkpoint->activate();
-        saveGame();
+        world->saveGame();
+        if (practice_mode)
+            world->snapshot(world->practice_snapshot);
     }
 
     void kill()
     {
         if (state != State::Death) {
-            for(auto n : rope_nodes)
-                n.destroy();
-            rope_joint.destroy();
-            sp::audio::Sound::play("sfx/death.wav");
+            removeRope();
+            world->playSound("sfx/death.wav");
             state = State::Death;
             respawn_delay = 30;
             camera_shake.start(0.3);
             setLinearVelocity({0, 0});
+            ProfileZone particles_zone("particle spawn");
             auto pe = new sp::ParticleEmitter(getParent(), "death.particles.txt");
             pe->setPosition(getPosition2D());
         }
@@ -742,13 +1000,14 @@ public:
         if (checkpoint)
             setPosition(checkpoint->getPosition2D());
         else
-            setPosition(start_position);
+            setPosition(world->start_position);
+        world->streamAround(getPosition2D());
         state = State::Falling;
         
         updateFallDepth();
 
         if (death_count == 0) {
-            first_death_timer.start(0.5);
+            first_death_delay = 30;
         }
         death_count++;
     }
@@ -763,6 +1022,7 @@ public:
 
     bool checkCollisionHorizontal(sp::Vector2d offset)
     {
+        ProfileZone zone("collision query");
         bool hit_solid = false;
         getScene()->queryCollisionAny({getPosition2D() + sp::Vector2d(0, offset.y), getPosition2D() + offset}, [&hit_solid](sp::P<sp::Node> node, sp::Vector2d hit_location, sp::Vector2d hit_normal) {
             if (node->isSolid())
@@ -774,6 +1034,7 @@ public:
 
     std::optional<sp::Vector2d> checkCollisionVertical(sp::Vector2d offset)
     {
+        ProfileZone zone("collision query");
         std::optional<sp::Vector2d> result;
         getScene()->queryCollisionAll({getPosition2D() + offset, getPosition2D() + sp::Vector2d(offset.x, -offset.y)}, [&result](sp::P<sp::Node> node, sp::Vector2d hit_location, sp::Vector2d hit_normal) {
             if (node->isSolid())
@@ -803,11 +1064,7 @@ public:
     void load(nlohmann::json& json) override {
         auto it = json.find("current_checkpoint");
         if (it != json.end()) {
-            int checkpoint_id = *it;
-            for(sp::P<Checkpoint> cp : getParent()->getChildren()) {
-                if (cp && cp->id == checkpoint_id)
-                    checkpoint = cp;
-            }
+            checkpoint = world->findCheckpoint(*it);
         }
         it = json.find("death_line");
         if (it != json.end() && bool(*it)) death_line->render_data.type = sp::RenderData::Type::Normal;
@@ -827,12 +1084,82 @@ public:
         if (it != json.end()) can_rope = *it;
     }
 
+    void snapshot(SnapshotWriter& writer) override {
+        writer.write(getPosition2D());
+        writer.write(getLinearVelocity2D());
+        writer.write(animationGetFlags());
+        writer.write(state);
+        writer.write(death_height);
+        writer.write(death_count);
+        writer.write(tele_count);
+        writer.write(jump_count);
+        writer.write(first_death_delay);
+        writer.write(in_water);
+        writer.write(to_fall_state_delay);
+        writer.write(jump_buffer);
+        writer.write(wall_jump_time);
+        writer.write(respawn_delay);
+        writer.write<int32_t>(checkpoint ? checkpoint->id : -1);
+        writer.write(bool(rope_joint));
+        writer.write(rope_attachpoint);
+        writer.write(rope_length);
+        writer.write(death_line->render_data.type == sp::RenderData::Type::Normal);
+        writer.write(can_hang);
+        writer.write(can_teleport);
+        writer.write(can_dive);
+        writer.write(can_rope);
+    }
+    void restore(SnapshotReader& reader) override {
+        setPosition(reader.read<sp::Vector2d>());
+        setLinearVelocity(reader.read<sp::Vector2d>());
+        animationSetFlags(reader.read<int>());
+        state = reader.read<State>();
+        death_height = reader.read<double>();
+        death_count = reader.read<int>();
+        tele_count = reader.read<int>();
+        jump_count = reader.read<int>();
+        first_death_delay = reader.read<int>();
+        in_water = reader.read<bool>();
+        to_fall_state_delay = reader.read<int>();
+        jump_buffer = reader.read<int>();
+        wall_jump_time = reader.read<int>();
+        respawn_delay = reader.read<int>();
+        checkpoint = world->findCheckpoint(reader.read<int32_t>());
+        bool had_rope = reader.read<bool>();
+        rope_attachpoint = reader.read<sp::Vector2d>();
+        rope_length = reader.read<double>();
+        death_line->render_data.type = reader.read<bool>() ? sp::RenderData::Type::Normal : sp::RenderData::Type::None;
+        can_hang = reader.read<bool>();
+        can_teleport = reader.read<bool>();
+        can_dive = reader.read<bool>();
+        can_rope = reader.read<bool>();
+        frozen = false;
+
+        removeRope();
+        if (had_rope) {
+            //Find what the rope was attached to again, just past the attach point so the hit is not missed.
+            auto target = rope_attachpoint + (rope_attachpoint - getPosition2D()).normalized() * 0.1;
+            getScene()->queryCollisionAll({getPosition2D(), target}, [&](sp::P<sp::Node> node, sp::Vector2d hit_location, sp::Vector2d hit_normal) {
+                if (!node->isSolid())
+                    return true;
+                attachRope(node, rope_attachpoint, rope_length);
+                return false;
+            });
+        }
+        if (state == State::Teleport)
+            buildTeleArrows();
+        else
+            removeTeleArrows();
+    }
+
     sp::Vector2d velocity;
     double death_height = -10000;
     int death_count = 0;
     int tele_count = 0;
     int jump_count = 0;
-    sp::Timer first_death_timer;
+    int first_death_delay = 0;
+    bool frozen = false;
+    sp::Vector2d frozen_velocity;
     sp::P<sp::Node> death_line;
     bool in_water = false;
     enum class State {
@@ -853,9 +1180,10 @@ public:
     sp::P<Checkpoint> checkpoint;
     int respawn_delay = 0;
     sp::Vector2d rope_attachpoint;
+    double rope_length = 0.0;
     sp::P<sp::collision::RopeJoint2D> rope_joint;
-    sp::PList<sp::Node> rope_nodes;
-    sp::PList<sp::Node> teleport_arrows;
+    sp::PList<PooledNode> rope_nodes;
+    sp::PList<PooledNode> teleport_arrows;
 
     bool can_hang = false;
     bool can_teleport = false;
@@ -863,9 +1191,7 @@ public:
     bool can_rope = false;
     sp::Timer camera_shake;
 };
-sp::P<Player> player;
-
-class Pickup : public sp::Node, public SaveProgressInterface
+class Pickup : public WorldNode, public SaveProgressInterface
 {
 public:
     enum class Type {
@@ -876,24 +1202,27 @@ public:
         RadioactiveSpider,
     };
     Pickup(sp::P<sp::Node> parent, sp::Vector2d position, Type type, int id)
-    : sp::Node(parent), type(type), position(position), id(id)
+    : WorldNode(parent), type(type), position(position), id(id)
     {
+        world->registerSaveProgress(this);
         render_data.shader = sp::Shader::get("internal:basic.shader");
-        render_data.mesh = sp::MeshData::createQuad({1, 1});
         render_data.type = sp::RenderData::Type::Normal;
+        sp::string image;
         switch(type)
         {
-        case Type::TapeMeasure: render_data.texture = sp::texture_manager.get("tapemeasure.png"); break;
-        case Type::ClimbingGlove: render_data.texture = sp::texture_manager.get("climbingglove.png"); break;
-        case Type::Teleport: render_data.texture = sp::texture_manager.get("teleport.png"); break;
-        case Type::DivingHelmet: render_data.texture = sp::texture_manager.get("diving.png"); break;
-        case Type::RadioactiveSpider: render_data.texture = sp::texture_manager.get("rspider.png"); break;
+        case Type::TapeMeasure: image = "tapemeasure.png"; break;
+        case Type::ClimbingGlove: image = "climbingglove.png"; break;
+        case Type::Teleport: image = "teleport.png"; break;
+        case Type::DivingHelmet: image = "diving.png"; break;
+        case Type::RadioactiveSpider: image = "rspider.png"; break;
         }
+        render_data.mesh = sprite_atlas.getQuad(image, {1, 1});
+        render_data.texture = sprite_atlas.getTexture(image);
         setPosition(position);
-        emitters.add(new sp::ParticleEmitter(getParent(), "pickup.particles.a.txt"));
-        emitters.add(new sp::ParticleEmitter(getParent(), "pickup.particles.b.txt"));
+        //Emitters are our children, so they are removed together with us when our chunk is unloaded.
+        emitters.add(new sp::ParticleEmitter(this, "pickup.particles.a.txt"));
+        emitters.add(new sp::ParticleEmitter(this, "pickup.particles.b.txt"));
         for(auto e : emitters) {
-            e->setPosition(position);
             e->render_data.order = -1;
         }
         sp::collision::Box2D shape{0.5, 0.5};
@@ -901,57 +1230,53 @@ public:
         setCollisionShape(shape);
     }
 
-    virtual void onUpdate(float delta) override
-    {
-    }
-
     void onCollision(sp::CollisionInfo& info) override
     {
-        if (info.other != player) return;
-        sp::audio::Sound::play("sfx/pickup.wav");
+        if (info.other != world->player || world->message_visible) return;
+        world->playSound("sfx/pickup.wav");
         switch(type) {
         case Type::TapeMeasure:
-            showMessage("Found the tapemeasure!", [](){
-                showMessage("Now you can measure how far\nyou can fall before you die", []() {
-                    player->death_line->render_data.type = sp::RenderData::Type::Normal;
-                    saveGame();
+            world->showMessage("Found the tapemeasure!", [world=world]() {
+                world->showMessage("Now you can measure how far\nyou can fall before you die", [world]() {
+                    world->player->death_line->render_data.type = sp::RenderData::Type::Normal;
+                    world->saveGame();
                 });
             });
             break;
         case Type::ClimbingGlove:
-            showMessage("Found the climbing glove!", [](){
-                showMessage("You can now hang on\nthe edges of cliffs", []() {
-                    showMessage("Press the UP key to\nclimb up when hanging", []() {
-                        player->can_hang = true;
-                        saveGame();
+            world->showMessage("Found the climbing glove!", [world=world]() {
+                world->showMessage("You can now hang on\nthe edges of cliffs", [world]() {
+                    world->showMessage("Press the UP key to\nclimb up when hanging", [world]() {
+                        world->player->can_hang = true;
+                        world->saveGame();
                     });
                 });
             });
             break;
         case Type::Teleport:
-            showMessage("Found the magic hat!", [](){
-                showMessage("Hold UP on flags\nto teleport", []() {
-                    player->can_teleport = true;
-                    saveGame();
+            world->showMessage("Found the magic hat!", [world=world]() {
+                world->showMessage("Hold UP on flags\nto teleport", [world]() {
+                    world->player->can_teleport = true;
+                    world->saveGame();
                 });
             });
             break;
         case Type::DivingHelmet:
-            showMessage("Found the diving helmet!", [](){
-                showMessage("You can now swim\nunder water", []() {
-                    showMessage("Comes with unlimited air\n(don't question it)", []() {
-                        player->can_dive = true;
-                        saveGame();
+            world->showMessage("Found the diving helmet!", [world=world]() {
+                world->showMessage("You can now swim\nunder water", [world]() {
+                    world->showMessage("Comes with unlimited air\n(don't question it)", [world]() {
+                        world->player->can_dive = true;
+                        world->saveGame();
                     });
                 });
             });
             break;
         case Type::RadioactiveSpider:
-            showMessage("Found a radioactive spider!", [](){
-                showMessage("You suddenly shoot\nwebs out of your wrists", []() {
-                    showMessage("Press and hold jump\nwhile jumping to swing!", []() {
-                        player->can_rope = true;
-                        saveGame();
+            world->showMessage("Found a radioactive spider!", [world=world]() {
+                world->showMessage("You suddenly shoot\nwebs out of your wrists", [world]() {
+                    world->showMessage("Press and hold jump\nwhile jumping to swing!", [world]() {
+                        world->player->can_rope = true;
+                        world->saveGame();
                     });
                 });
             });
@@ -987,95 +1312,149 @@ public:
     int id;
 };
 
-class IntroCloud : public sp::Node
+//All clouds of the intro in a single node, drawn as one mesh. Clouds drift along the flight direction of the plane,
+//and are dropped once they passed it. After the crash they all fade out together, and the field removes itself.
+class IntroCloudField : public WorldNode
 {
 public:
-    IntroCloud(sp::P<sp::Node> parent)
-    : sp::Node(parent)
+    static constexpr int max_clouds = 256;
+    //New clouds per second while waiting for the initial start, independent of the frame rate.
+    static constexpr double spawn_rate = 60.0;
+
+    IntroCloudField(sp::P<sp::Node> parent)
+    : WorldNode(parent)
     {
         render_data.shader = sp::Shader::get("internal:color.shader");
-        render_data.mesh = sp::MeshData::createQuad({sp::random(0.5, 1.0), sp::random(0.25, 0.5)});
-        render_data.type = sp::RenderData::Type::Normal;
-        velocity = sp::random(-2, 2);
+    }
+
+    void spawn(sp::Vector2d position) {
+        if (cloud_count == max_clouds)
+            return;
+        auto& cloud = clouds[cloud_count++];
+        cloud.position = position;
+        cloud.size = sp::Vector2d(sp::random(0.5, 1.0), sp::random(0.25, 0.5)) * 0.5;
+        cloud.velocity = sp::random(-2, 2);
     }
 
     void onUpdate(float delta) override {
-        setPosition(getPosition2D() + (plane_start_position - start_position).normalized() * double(delta * velocity));
-        switch(intro_state)
-        {
-        case IntroState::WaitForInitialStart:
-            setPosition(getPosition2D() + (plane_start_position - start_position).normalized() * double(delta * 20.0));
-            if (getPosition2D().x < plane_start_position.x - 20)
-                delete this;
-            break;
-        case IntroState::CrashingDown:
-            break;
-        case IntroState::Crashed:
-        case IntroState::Done:
+        auto direction = (world->plane_start_position - world->start_position).normalized();
+        bool waiting = world->intro_state == IntroState::WaitForInitialStart;
+        if (waiting) {
+            spawn_time += delta;
+            while(spawn_time >= 1.0 / spawn_rate) {
+                spawn_time -= 1.0 / spawn_rate;
+                spawn(world->plane_start_position + sp::Vector2d(20, sp::random(-20, 20)).rotate((-direction).angle()));
+            }
+        }
+        for(int n=0; n<cloud_count; ) {
+            auto& cloud = clouds[n];
+            cloud.position += direction * double(delta * (waiting ? cloud.velocity + 20.0 : cloud.velocity));
+            if (waiting && cloud.position.x < world->plane_start_position.x - 20) {
+                cloud = clouds[--cloud_count];
+                continue;
+            }
+            n++;
+        }
+        if (world->intro_state == IntroState::Crashed || world->intro_state == IntroState::Done) {
             render_data.color.a -= delta;
-            if (render_data.color.a <= 0.0)
+            if (render_data.color.a <= 0.0) {
                 delete this;
-            break;
+                return;
+            }
+        }
+        updateMesh();
+    }
+
+private:
+    void updateMesh() {
+        sp::MeshData::Vertices vertices;
+        sp::MeshData::Indices indices;
+        vertices.reserve(cloud_count * 4);
+        indices.reserve(cloud_count * 6);
+        for(int n=0; n<cloud_count; n++) {
+            auto p = clouds[n].position;
+            auto s = clouds[n].size;
+            uint16_t index = uint16_t(vertices.size());
+            vertices.emplace_back(sp::Vector3f(p.x - s.x, p.y - s.y, 0.0f), sp::Vector3f(0.0f, 0.0f, 1.0f), sp::Vector2f(0, 1));
+            vertices.emplace_back(sp::Vector3f(p.x + s.x, p.y - s.y, 0.0f), sp::Vector3f(0.0f, 0.0f, 1.0f), sp::Vector2f(1, 1));
+            vertices.emplace_back(sp::Vector3f(p.x - s.x, p.y + s.y, 0.0f), sp::Vector3f(0.0f, 0.0f, 1.0f), sp::Vector2f(0, 0));
+            vertices.emplace_back(sp::Vector3f(p.x + s.x, p.y + s.y, 0.0f), sp::Vector3f(0.0f, 0.0f, 1.0f), sp::Vector2f(1, 0));
+            for(int i : {0, 1, 2, 2, 1, 3})
+                indices.push_back(index + i);
         }
+        render_data.type = cloud_count > 0 ? sp::RenderData::Type::Normal : sp::RenderData::Type::None;
+        if (!render_data.mesh)
+            render_data.mesh = sp::MeshData::create(std::move(vertices), std::move(indices), sp::MeshData::Type::Dynamic);
+        else
+            render_data.mesh->update(std::move(vertices), std::move(indices));
     }
 
-    float anim_time = 0.0;
-    double velocity = 0;
+    struct Cloud {
+        sp::Vector2d position;
+        sp::Vector2d size; //half size
+        double velocity;
+    };
+    Cloud clouds[max_clouds];
+    int cloud_count = 0;
+    double spawn_time = 0.0;
 };
 
-class Plane : public sp::Node
+class Plane : public WorldNode, public TickListener
 {
 public:
     Plane(sp::P<sp::Node> parent)
-    : sp::Node(parent)
+    : WorldNode(parent)
     {
         render_data.shader = sp::Shader::get("internal:basic.shader");
-        render_data.mesh = sp::MeshData::createQuad({3, 2});
+        render_data.mesh = sprite_atlas.getQuad("plane.png", {3, 2});
         render_data.type = sp::RenderData::Type::Normal;
-        render_data.texture = sp::texture_manager.get("plane.png");
+        render_data.texture = sprite_atlas.getTexture("plane.png");
         //setAnimation(sp::SpriteAnimation::load("player.txt"));
         //animationPlay("Idle");
-        for(int n=0; n<60; n++) {
-            auto cloud = new IntroCloud(getParent());
-            cloud->setPosition(plane_start_position + sp::Vector2d(sp::random(-20, 20), sp::random(-20, 20)).rotate(getRotation2D()));
-        }
+        clouds = new IntroCloudField(getParent());
+        for(int n=0; n<60; n++)
+            clouds->spawn(world->plane_start_position + sp::Vector2d(sp::random(-20, 20), sp::random(-20, 20)).rotate(getRotation2D()));
 
         engine_emitter = new sp::ParticleEmitter(this, "plane.engine.particles.txt");
         engine_emitter->setPosition({-0.5, 0});
+        world->tick_scheduler.wake(this, TickScheduler::FixedUpdate);
     }
 
-    void onUpdate(float delta) override {
-        switch(intro_state) {
+    //The intro decides when the player appears, so it runs in fixed ticks to keep replays deterministic.
+    //After the intro the plane is only a wreck, and sleeps.
+    void onScheduledFixedUpdate() override {
+        if (world->message_visible) return;
+        float delta = sp::Engine::fixed_update_delta;
+        switch(world->intro_state) {
         case IntroState::WaitForInitialStart: {
             anim_time += delta;
             auto anim_y = std::sin(anim_time) * 0.5 + std::sin(anim_time / 3.15) * 0.25 + std::cos(anim_time * 5.15) * 0.1;
-            setPosition(plane_start_position + sp::Vector2d(0, anim_y).rotate(getRotation2D()));
+            setPosition(world->plane_start_position + sp::Vector2d(0, anim_y).rotate(getRotation2D()));
 
-            auto cloud = new IntroCloud(getParent());
-            cloud->setPosition(plane_start_position + sp::Vector2d(20, sp::random(-20, 20)).rotate(getRotation2D()));
-            if (key_jump.getDown() || key_menu.getDown()) {
-                intro_state = IntroState::CrashingDown;
-                plane_start_position = getPosition2D();
+            if (world->key_jump.getDown() || world->key_menu.getDown()) {
+                world->intro_state = IntroState::CrashingDown;
+                world->plane_start_position = getPosition2D();
                 anim_time = 0;
             }
             }break;
         case IntroState::CrashingDown:{
-            setPosition(getPosition2D() + (start_position - plane_start_position).normalized() * double(delta * 20.0));
-            camera->setPosition(camera->getPosition2D() + (start_position - plane_start_position).normalized() * double(delta * 20.0));
-            if (getPosition2D().y < start_position.y) {
-                setPosition({getPosition2D().x, start_position.y});
-                intro_state = IntroState::Crashed;
-                player = new Player(getScene()->getRoot());
-                player->setPosition(start_position);
-                player->camera_shake.start(0.4);
+            setPosition(getPosition2D() + (world->start_position - world->plane_start_position).normalized() * double(delta * 20.0));
+            world->camera->setPosition(world->camera->getPosition2D() + (world->start_position - world->plane_start_position).normalized() * double(delta * 20.0));
+            if (getPosition2D().y < world->start_position.y) {
+                setPosition({getPosition2D().x, world->start_position.y});
+                world->intro_state = IntroState::Crashed;
+                world->player = new Player(getScene()->getRoot());
+                world->player->setPosition(world->start_position);
+                world->player->camera_shake.start(0.4);
                 engine_emitter->stopSpawn();
                 engine_emitter->auto_destroy = true;
+                crashed_delay = 30;
 
                 auto pe = new sp::ParticleEmitter(this, "plane.engine.particles.b.txt");
                 pe->setPosition({-0.8, 0});
                 pe->setRotation(-getRotation2D());
 
-                sp::audio::Sound::play("sfx/explosion.wav");
+                world->playSound("sfx/explosion.wav");
                 auto ee = new sp::ParticleEmitter(getParent(), "plane.explosion.particles.a.txt");
                 ee->setPosition(getPosition2D());
                 ee = new sp::ParticleEmitter(getParent(), "plane.explosion.particles.b.txt");
@@ -1083,52 +1462,126 @@ public:
             }
             }break;
         case IntroState::Crashed:{
-            if (!engine_emitter) {
-                showMessage("... auch ...", []() {
-                    showMessage("I seem to have crashed\non the top of this mountain.", []() {
-                        showMessage("I better try to get down.", []() {
-                            sp::gui::Loader::load("gui/title.gui", "TITLE");
-                            sp::audio::Music::play("music/A Tale of Wind - MP3.ogg");
+            //Wait for the engine particles to fade out.
+            if (crashed_delay > 0)
+                crashed_delay--;
+            if (crashed_delay == 0) {
+                world->showMessage("... auch ...", [world=world]() {
+                    world->showMessage("I seem to have crashed\non the top of this mountain.", [world]() {
+                        world->showMessage("I better try to get down.", [world]() {
+                            world->loadGui("gui/title.gui", "TITLE");
+                            world->playMusic("music/A Tale of Wind - MP3.ogg");
                         });
                     });
                 });
-                intro_state = IntroState::Done;
+                world->intro_state = IntroState::Done;
             }
             }break;
         case IntroState::Done:
+            world->tick_scheduler.sleep(this, TickScheduler::FixedUpdate);
             break;
         }
     }
 
     sp::P<sp::ParticleEmitter> engine_emitter;
+    sp::P<IntroCloudField> clouds;
     float anim_time = 0.0;
+    int crashed_delay = 0;
 };
 
-class HideLayerTrigger : public sp::Node
+//Fades layers in and out. Only layers in the middle of a fade are visited each frame,
+//a layer that is fully shown or hidden is not touched until the next fade starts.
+class LayerFader : public WorldNode
 {
 public:
-    HideLayerTrigger(sp::P<sp::Node> parent, sp::Rect2d area)
-    : sp::Node(parent), area(area)
+    LayerFader(sp::P<sp::Node> parent)
+    : WorldNode(parent)
+    {
+    }
+
+    //Move the alpha of the layer towards target at one unit per second.
+    void fade(sp::P<sp::Node> layer, float target)
     {
+        for(auto& fade : fades) {
+            if (fade.layer == layer) {
+                fade.target = target;
+                return;
+            }
+        }
+        if (layer->render_data.color.a != target)
+            fades.push_back({layer, target});
     }
 
     void onUpdate(float delta) override
     {
-        if (player && area.contains(player->getPosition2D())) {
-            getParent()->render_data.color.a = std::max(0.0f, getParent()->render_data.color.a - delta);
-        } else {
-            getParent()->render_data.color.a = std::min(1.0f, getParent()->render_data.color.a + delta);
+        if (fades.empty())
+            return;
+        for(auto& fade : fades) {
+            if (!fade.layer)
+                continue;
+            auto& alpha = fade.layer->render_data.color.a;
+            if (alpha < fade.target)
+                alpha = std::min(fade.target, alpha + delta);
+            else
+                alpha = std::max(fade.target, alpha - delta);
         }
+        fades.erase(std::remove_if(fades.begin(), fades.end(), [](const Fade& fade) {
+            return !fade.layer || fade.layer->render_data.color.a == fade.target;
+        }), fades.end());
+    }
+
+    void restart() override
+    {
+        fades.clear();
+    }
+
+private:
+    struct Fade {
+        sp::P<sp::Node> layer;
+        float target;
+    };
+    std::vector<Fade> fades;
+};
+
+//Hides its layer while the player is inside the area. Does nothing per frame, the enter and exit
+//events of the area start a fade on the LayerFader.
+class HideLayerTrigger : public WorldNode, public TriggerListener
+{
+public:
+    HideLayerTrigger(sp::P<sp::Node> parent, sp::Rect2d area)
+    : WorldNode(parent), area(area)
+    {
+        world->trigger_grid.add(this, area);
+    }
+
+    void onTriggerEnter() override
+    {
+        player_inside = true;
+        world->layer_fader->fade(getParent(), 0.0f);
+    }
+
+    void onTriggerExit() override
+    {
+        player_inside = false;
+        world->layer_fader->fade(getParent(), 1.0f);
+    }
+
+    //World::reset shows all layers again, while the new player can start inside the area without a new enter event.
+    void restart() override
+    {
+        if (player_inside)
+            world->layer_fader->fade(getParent(), 0.0f);
     }
 
     sp::Rect2d area;
+    bool player_inside = false;
 };
 
-class KillZone : public sp::Node
+class KillZone : public WorldNode
 {
 public:
     KillZone(sp::P<sp::Node> parent, sp::Vector2d position, sp::Vector2d size)
-    : sp::Node(parent)
+    : WorldNode(parent)
     {
         setPosition(position);
         sp::collision::Box2D shape{size.x, size.y};
@@ -1136,23 +1589,53 @@ public:
         setCollisionShape(shape);
     }
 
+    //Single sensor covering a row of run_length spike tiles, starting at the left or bottom most tile.
+    KillZone(sp::P<sp::Node> parent, sp::Vector2i tile, LevelData::TileSpecial direction, int run_length)
+    : KillZone(parent, sp::Vector2d(tile) + spikeOffset(direction, run_length), spikeSize(direction, run_length))
+    {
+    }
+
+    static bool isHorizontalSpike(LevelData::TileSpecial direction)
+    {
+        return direction == LevelData::TileSpecial::SpikeUp || direction == LevelData::TileSpecial::SpikeDown;
+    }
+
+    static sp::Vector2d spikeOffset(LevelData::TileSpecial direction, int run_length)
+    {
+        switch(direction) {
+        case LevelData::TileSpecial::SpikeDown: return {run_length * 0.5, 0.1};
+        case LevelData::TileSpecial::SpikeUp: return {run_length * 0.5, 0.9};
+        case LevelData::TileSpecial::SpikeLeft: return {0.1, run_length * 0.5};
+        case LevelData::TileSpecial::SpikeRight: return {0.9, run_length * 0.5};
+        default: return {0.5, 0.5};
+        }
+    }
+
+    static sp::Vector2d spikeSize(LevelData::TileSpecial direction, int run_length)
+    {
+        if (isHorizontalSpike(direction))
+            return {run_length - 0.2, 0.2};
+        return {0.2, run_length - 0.2};
+    }
+
     void onCollision(sp::CollisionInfo& info) override
     {
-        if (info.other != player) return;
-        player->kill();
+        if (info.other != world->player) return;
+        world->player->kill();
     }
 };
 
-class FallingBlock : public sp::Node
+//Sleeps in the tick scheduler while idle, touching it wakes it up till it is back in place.
+class FallingBlock : public WorldNode, public TickListener
 {
 public:
     FallingBlock(sp::P<sp::Node> parent, sp::Vector2d position)
-    : sp::Node(parent), position(position)
+    : WorldNode(parent), position(position)
     {
         render_data.shader = sp::Shader::get("internal:basic.shader");
-        render_data.mesh = sp::MeshData::createQuad({2, 1});
+        render_data.mesh = sprite_atlas.getQuad("fallingblock2x1.png", {2, 1});
         render_data.type = sp::RenderData::Type::Normal;
-        render_data.texture = sp::texture_manager.get("fallingblock2x1.png");
+        render_data.texture = sprite_atlas.getTexture("fallingblock2x1.png");
         render_data.order = -1;
 
         setPosition(position);
@@ -1161,15 +1644,29 @@ public:
         setCollisionShape(shape);
     }
 
-    void onFixedUpdate() override
+    void onScheduledFixedUpdate() override
     {
+        if (world->message_visible) {
+            if (!frozen) {
+                frozen = true;
+                frozen_velocity = getLinearVelocity2D();
+            }
+            setLinearVelocity({0, 0});
+            return;
+        }
+        if (frozen) {
+            frozen = false;
+            setLinearVelocity(frozen_velocity);
+        }
+        if (state_ticks > 0)
+            state_ticks--;
         switch(state) {
         case State::Idle: break;
         case State::Triggered:
-            if (state_timer.isExpired()) {
+            if (state_ticks == 0) {
                 state = State::Falling;
-                state_timer.start(2.5);
-                sp::audio::Sound::play("sfx/breakblock.wav");
+                state_ticks = 150;
+                world->playSound("sfx/breakblock.wav");
             }
             break;
         case State::Falling:
@@ -1179,10 +1676,11 @@ public:
                 shape.type = sp::collision::Shape::Type::Sensor;
                 setCollisionShape(shape);
             }
-            if (state_timer.isExpired()) {
+            if (state_ticks == 0) {
                 setPosition(position);
                 setLinearVelocity({0, 0});
                 state = State::Idle;
+                world->tick_scheduler.sleep(this, TickScheduler::FixedUpdate);
 
                 sp::collision::Box2D shape{2.0, 1.0};
                 shape.type = sp::collision::Shape::Type::Kinematic;
@@ -1194,43 +1692,88 @@ public:
 
     void onCollision(sp::CollisionInfo& info) override
     {
-        if (info.other != player) return;
+        if (info.other != world->player || world->message_visible) return;
         if (state == State::Idle) {
             state = State::Triggered;
-            state_timer.start(0.8);
+            state_ticks = 48;
+            world->tick_scheduler.wake(this, TickScheduler::FixedUpdate);
         }
     }
 
+    void snapshot(SnapshotWriter& writer) override {
+        writer.write(getPosition2D());
+        writer.write(frozen ? frozen_velocity : getLinearVelocity2D());
+        writer.write(state);
+        writer.write(state_ticks);
+    }
+    void restore(SnapshotReader& reader) override {
+        setPosition(reader.read<sp::Vector2d>());
+        setLinearVelocity(reader.read<sp::Vector2d>());
+        state = reader.read<State>();
+        state_ticks = reader.read<int>();
+        frozen = false;
+        if (state == State::Idle)
+            world->tick_scheduler.sleep(this, TickScheduler::FixedUpdate);
+        else
+            world->tick_scheduler.wake(this, TickScheduler::FixedUpdate);
+        sp::collision::Box2D shape{2.0, 1.0};
+        if (state == State::Falling && getLinearVelocity2D().y <= -10)
+            shape.type = sp::collision::Shape::Type::Sensor;
+        else
+            shape.type = sp::collision::Shape::Type::Kinematic;
+        setCollisionShape(shape);
+    }
+
     sp::Vector2d position;
     enum class State {
         Idle,
         Triggered,
         Falling,
     } state = State::Idle;
-    sp::Timer state_timer;
+    //Timing is done in fixed ticks, so it does not depend on the frame rate.
+    int state_ticks = 0;
+    bool frozen = false;
+    sp::Vector2d frozen_velocity;
 };
 
-class MessageSignTrigger : public sp::Node
+//Shows its message while the player walks near it. The sign is only updated from the tick scheduler while the player
+//is near or the popup is still closing, so signs elsewhere in the level cost nothing per frame.
+class MessageSignTrigger : public WorldNode, public TriggerListener, public TickListener
 {
 public:
-    MessageSignTrigger(sp::P<sp::Node> parent)
-    : sp::Node(parent)
+    MessageSignTrigger(sp::P<sp::Node> parent, sp::Vector2d position)
+    : WorldNode(parent)
     {
+        setPosition(position);
+        world->trigger_grid.add(this, position, 1.0);
     }
 
-    void onUpdate(float delta) override
+    ~MessageSignTrigger()
+    {
+        popup_message.destroy();
+    }
+
+    void onTriggerEnter() override
+    {
+        player_near = true;
+        if (world->interactive)
+            world->tick_scheduler.wake(this, TickScheduler::Update);
+    }
+    void onTriggerExit() override { player_near = false; }
+
+    void onScheduledUpdate(float delta) override
     {
-        if (player && player->state == Player::State::Walking && (player->getPosition2D() - getPosition2D()).length() < 1.0) {
+        if (player_near && world->player && world->player->state == Player::State::Walking) {
             if (!popup_message) {
-                popup_message = sp::gui::Loader::load("gui/msgbox.gui", "MSGBOX");
+                popup_message = world->loadGui("gui/msgbox.gui", "MSGBOX");
                 if (secret) {
                     popup_message->getWidgetWithID("MSG")->setAttribute("style", "secret");
                     popup_message->getWidgetWithID("MSG")->setAttribute("text.alignment", "center");
-                    decode_message = message.format([](const sp::string& key) {
+                    decode_message = message.format([this](const sp::string& key) {
                         int number = sp::stringutil::convert::toInt(key);
-                        if (key == "D") number = player->death_count;
-                        if (key == "T") number = player->tele_count;
-                        if (key == "J") number = player->jump_count;
+                        if (key == "D") number = world->player->death_count;
+                        if (key == "T") number = world->player->tele_count;
+                        if (key == "J") number = world->player->jump_count;
                         sp::string result;
                         while(number > 0) {
                             int digit = number % 15;
@@ -1256,11 +1799,14 @@ public:
                 if (msgsize < 1.0)
                     popup_message.destroy();
             }
+            if (!player_near && !popup_message)
+                world->tick_scheduler.sleep(this, TickScheduler::Update);
         }
     }
 
     float msgsize = 0.0;
     bool secret = false;
+    bool player_near = false;
     sp::P<sp::gui::Widget> popup_message;
     sp::string message;
     sp::string decode_message;
@@ -1311,49 +1857,57 @@ public:
     } state = State::Spawn;
 };
 
-class SecretTrigger : public sp::Node, public SaveProgressInterface
+class SecretTrigger : public WorldNode, public SaveProgressInterface, public TriggerListener
 {
 public:
-    SecretTrigger(sp::P<sp::Node> parent)
-    : sp::Node(parent) {
+    SecretTrigger(sp::P<sp::Node> parent, sp::Vector2d position)
+    : WorldNode(parent) {
+        setPosition(position);
+        world->registerSaveProgress(this);
+        world->trigger_grid.add(this, position, 2.0);
     }
 
-    void onFixedUpdate() override
+    //The code is only entered while the player stays close, leaving starts it over.
+    void onTriggerExit() override
     {
-        if (finished) return;
-        if (!player || (player->getPosition2D() - getPosition2D()).length() > 2.0) {
-            reset();
-            return;
-        }
+        reset();
+    }
 
-        if (key_jump.getDown()) { if (code[step] == 'J') step++; else reset(); }
-        if (key_up.getDown()) { if (code[step] == 'U') step++; else reset(); }
-        if (key_down.getDown()) { if (code[step] == 'D') step++; else reset(); }
-        if (key_left.getDown()) { if (code[step] == 'L') step++; else reset(); }
-        if (key_right.getDown()) { if (code[step] == 'R') step++; else reset(); }
+    void onTriggerStay() override
+    {
+        if (finished || world->message_visible) return;
+
+        if (world->key_jump.getDown()) { if (code[step] == 'J') step++; else reset(); }
+        if (world->key_up.getDown()) { if (code[step] == 'U') step++; else reset(); }
+        if (world->key_down.getDown()) { if (code[step] == 'D') step++; else reset(); }
+        if (world->key_left.getDown()) { if (code[step] == 'L') step++; else reset(); }
+        if (world->key_right.getDown()) { if (code[step] == 'R') step++; else reset(); }
         if (code[step] == 'W') {
-            if (!wait_timer.isRunning())
-                wait_timer.start(sp::stringutil::convert::toFloat(code.substr(step+1)));
-            if (wait_timer.isExpired()) {
+            if (wait_ticks < 0)
+                wait_ticks = int(std::round(sp::stringutil::convert::toFloat(code.substr(step+1)) / sp::Engine::fixed_update_delta));
+            if (wait_ticks > 0)
+                wait_ticks--;
+            if (wait_ticks == 0) {
+                wait_ticks = -1;
                 step++;
                 while(strchr("0123456789.", code[step])) step++;
             }
         }
         if (step == code.length()) {
             finished = true;
-            saveGame();
+            world->saveGame();
 
-            sp::audio::Sound::play("sfx/secret.wav");
-            auto sc = new SecretCube(getParent());
-            sc->start = player->getPosition2D() + sp::Vector2d(0, 1.5);
-            sc->target = secret_target[key];
-            sc->setPosition(sc->start);
+            world->playSound("sfx/secret.wav");
+            cube = new SecretCube(getParent());
+            cube->start = world->player->getPosition2D() + sp::Vector2d(0, 1.5);
+            cube->target = world->secret_target[key];
+            cube->setPosition(cube->start);
         }
     }
 
     void reset() {
         step = 0;
-        wait_timer.stop();
+        wait_ticks = -1;
     }
 
     void save(nlohmann::json& json) override {
@@ -1363,46 +1917,127 @@ public:
         auto it = json.find("secret_" + key);
         if (it != json.end() && bool(*it)) {
             finished = true;
-            auto sc = new SecretCube(getParent());
-            sc->start = secret_target[key];
-            sc->target = secret_target[key];
-            sc->setPosition(sc->start);
+            placeCube();
         }
     }
 
+    void snapshot(SnapshotWriter& writer) override {
+        writer.write(finished);
+        writer.write(step);
+        writer.write(wait_ticks);
+    }
+    void restore(SnapshotReader& reader) override {
+        finished = reader.read<bool>();
+        step = reader.read<size_t>();
+        wait_ticks = reader.read<int>();
+        if (finished && !cube)
+            placeCube();
+        if (!finished)
+            cube.destroy();
+    }
+    void restart() override {
+        finished = false;
+        reset();
+        cube.destroy();
+    }
+
+    void placeCube() {
+        cube = new SecretCube(getParent());
+        cube->start = world->secret_target[key];
+        cube->target = world->secret_target[key];
+        cube->setPosition(cube->start);
+    }
+
     bool finished = false;
     size_t step = 0;
-    sp::Timer wait_timer;
+    int wait_ticks = -1;
     sp::string code;
     sp::string key;
+    sp::P<SecretCube> cube;
 };
 
-class TilemapAnimator : public sp::Node
+//All animated tiles of the level live in a single tilemap. Every animated tile of the tileset runs through
+//its own frames with the durations from the level, and only the cells showing a tile are updated when its frame changes.
+class TileAnimator : public sp::Node
 {
 public:
-    TilemapAnimator(sp::P<sp::Node> parent)
+    TileAnimator(sp::P<sp::Node> parent)
     : sp::Node(parent) {
-        timer.repeat(0.3);
+        tilemap = new sp::Tilemap(parent, "tileset.png", 1.0, 1.0, 10, 10);
+        tilemap->render_data.order = -99;
+    }
+
+    void addCell(sp::Vector2i position, int tile, const std::vector<LevelData::AnimationFrame>& frames) {
+        auto& animation = animations[tile];
+        if (!animation.frames) {
+            animation.frames = &frames;
+            for(auto& frame : frames)
+                animation.total_duration += frame.duration;
+            animation.frame = frameAt(animation, time);
+        }
+        animation.cells.push_back(position);
+        tilemap->setTile(position, (*animation.frames)[animation.frame].tile);
+    }
+
+    void removeCell(sp::Vector2i position, int tile) {
+        auto it = animations.find(tile);
+        if (it == animations.end())
+            return;
+        auto& cells = it->second.cells;
+        auto cell = std::find(cells.begin(), cells.end(), position);
+        if (cell == cells.end())
+            return;
+        *cell = cells.back();
+        cells.pop_back();
+        tilemap->setTile(position, -1);
     }
 
     void onUpdate(float delta) override {
-        if(timer.isExpired()) {
-            tilemaps[active_index]->render_data.type = sp::RenderData::Type::None;
-            active_index = (active_index + 1) % tilemaps.size();
-            tilemaps[active_index]->render_data.type = sp::RenderData::Type::Normal;
+        time += delta;
+        for(auto& it : animations) {
+            auto& animation = it.second;
+            if (animation.cells.empty())
+                continue;
+            auto frame = frameAt(animation, time);
+            if (frame == animation.frame)
+                continue;
+            animation.frame = frame;
+            for(auto cell : animation.cells)
+                tilemap->setTile(cell, (*animation.frames)[frame].tile);
         }
     }
 
-    int active_index = 0;
-    std::vector<sp::P<sp::Tilemap>> tilemaps;
-    sp::Timer timer;
+    sp::P<sp::Tilemap> tilemap;
+
+private:
+    struct Animation {
+        const std::vector<LevelData::AnimationFrame>* frames = nullptr;
+        int total_duration = 0; //in milliseconds
+        size_t frame = 0;
+        std::vector<sp::Vector2i> cells;
+    };
+
+    static size_t frameAt(const Animation& animation, double time) {
+        if (animation.total_duration <= 0)
+            return 0;
+        int ms = int(std::fmod(time * 1000.0, double(animation.total_duration)));
+        for(size_t n=0; n<animation.frames->size(); n++) {
+            ms -= (*animation.frames)[n].duration;
+            if (ms < 0)
+                return n;
+        }
+        return animation.frames->size() - 1;
+    }
+
+    double time = 0.0;
+    std::unordered_map<int, Animation> animations;
 };
 
-class NormalExit : public sp::Node
+class NormalExit : public WorldNode
 {
 public:
     NormalExit(sp::P<sp::Node> parent)
-    : sp::Node(parent) {
+    : WorldNode(parent) {
         sp::collision::Box2D shape{0.1, 0.1};
         shape.type = sp::collision::Shape::Type::Sensor;
         setCollisionShape(shape);
@@ -1410,21 +2045,22 @@ public:
 
     void onCollision(sp::CollisionInfo& info) override
     {
-        if (info.other != player) return;
-        showMessage("As you leave,\nyou can only wonder,", [](){
-            showMessage("Was there more\nto all of this?", [](){
-                player->removeCollisionShape();
-                sp::gui::Loader::load("gui/ending.gui", "ENDING");
+        if (info.other != world->player || world->message_visible) return;
+        world->showMessage("As you leave,\nyou can only wonder,", [world=world]() {
+            world->showMessage("Was there more\nto all of this?", [world]() {
+                world->player->removeCollisionShape();
+                world->reached_ending = "normal";
+                world->loadGui("gui/ending.gui", "ENDING");
             });
         });
     }
 };
 
-class SecretExit : public sp::Node
+class SecretExit : public WorldNode
 {
 public:
     SecretExit(sp::P<sp::Node> parent)
-    : sp::Node(parent) {
+    : WorldNode(parent) {
         sp::collision::Box2D shape{0.1, 0.1};
         shape.type = sp::collision::Shape::Type::Sensor;
         setCollisionShape(shape);
@@ -1432,224 +2068,924 @@ public:
 
     void onCollision(sp::CollisionInfo& info) override
     {
-        if (info.other != player) return;
+        if (info.other != world->player || world->message_visible) return;
         for(sp::P<SecretTrigger> st : getParent()->getChildren()) {
             if (st && !st->finished) return;
         }
-        showMessage("You enter the\nmagical doorway", [](){
-            showMessage("No idea what paths\nyou will cross next...", [](){
-                player->removeCollisionShape();
-                sp::gui::Loader::load("gui/secret.ending.gui", "ENDING");
+        world->showMessage("You enter the\nmagical doorway", [world=world]() {
+            world->showMessage("No idea what paths\nyou will cross next...", [world]() {
+                world->player->removeCollisionShape();
+                world->reached_ending = "secret";
+                world->loadGui("gui/secret.ending.gui", "ENDING");
             });
         });
     }
 };
 
-sp::P<sp::Window> window;
-
-void createWorld()
+//Sends the events of the trigger areas for the position of the player. Created right after the InputTicker,
+//so triggers see the input of the current tick.
+class TriggerTicker : public WorldNode
 {
-    auto scene = new sp::Scene("MAIN");
-    camera = new sp::Camera(scene->getRoot());
-    camera->setOrtographic({5, 7});
-    scene->setDefaultCamera(camera);
-
-    std::unordered_map<int, sp::Tilemap::Collision> tile_collision;
-    enum class TileSpecial {
-        None,
-        SpikeUp,
-        SpikeDown,
-        SpikeLeft,
-        SpikeRight,
-        Water,
-        Moss,
-    };
-    std::unordered_map<int, TileSpecial> tile_special;
-    std::unordered_map<int, std::vector<int>> tile_animations;
-    auto json = nlohmann::json::parse(sp::io::ResourceProvider::get("map.json")->readAll());
-    for(auto& tile : json["tilesets"][0]["tiles"]) {
-        int tile_id = tile["id"];
-        if (tile.find("properties") != tile.end()) {
-            for(auto& prop : tile["properties"]) {
-                std::string name = prop["name"];
-                if (name == "solid" && bool(prop["value"]))
-                    tile_collision[tile_id] = sp::Tilemap::Collision::Solid;
-                if (name == "water" && bool(prop["value"]))
-                    tile_special[tile_id] = TileSpecial::Water;
-                if (name == "moss" && bool(prop["value"]))
-                    tile_special[tile_id] = TileSpecial::Moss;
-                if (name == "spikes") {
-                    if (std::string(prop["value"]) == "up") tile_special[tile_id] = TileSpecial::SpikeUp;
-                    if (std::string(prop["value"]) == "down") tile_special[tile_id] = TileSpecial::SpikeDown;
-                    if (std::string(prop["value"]) == "left") tile_special[tile_id] = TileSpecial::SpikeLeft;
-                    if (std::string(prop["value"]) == "right") tile_special[tile_id] = TileSpecial::SpikeRight;
-                }
-            }
-        }
-        if (tile.find("animation") != tile.end()) {
-            std::vector<int> animation;
-            for(auto& anim : tile["animation"])
-                animation.push_back(int(anim["tileid"]));
-            tile_animations[tile_id] = std::move(animation);
-        }
-    }
-    std::unordered_map<size_t, sp::P<TilemapAnimator>> animation_layers;
-    for(auto& layer : json["layers"]) {
-        if (layer["type"] == "tilelayer") {
-            auto tilemap = new sp::Tilemap(scene->getRoot(), "tileset.png", 1.0, 1.0, 10, 10);
-            tilemap->render_data.order = -100;
-            bool maintilemap = std::string(layer["name"]) == "MAIN";
-            tilemap_by_name[std::string(layer["name"])] = tilemap;
-            tilemap->setTilemapSpacingMargin(0.01, 0.0);
-            sp::Vector2i tile_min{99999,99999};
-            sp::Vector2i tile_max{-99999,-99999};
-            for(auto& chunk : layer["chunks"]) {
-                int x = chunk["x"];
-                int y = chunk["y"];
-                int w = chunk["width"];
-                int h = chunk["height"];
-                for(auto p : sp::Rect2i{{0, 0}, {w, h}}) {
-                    int tile_nr = int(chunk["data"][p.x + p.y * w]) - 1;
-                    if (tile_nr >= 0) {
-                        auto tp = sp::Vector2i{p.x + x, - p.y - y - 1};
-                        tile_min.x = std::min(tile_min.x, tp.x);
-                        tile_min.y = std::min(tile_min.y, tp.y);
-                        tile_max.x = std::max(tile_max.x, tp.x);
-                        tile_max.y = std::max(tile_max.y, tp.y);
-                        if (tile_animations.find(tile_nr) != tile_animations.end()) {
-                            const auto& anim = tile_animations[tile_nr];
-                            if (animation_layers.find(anim.size()) == animation_layers.end()) {
-                                animation_layers[anim.size()] = new TilemapAnimator(scene->getRoot());
-                                for(size_t n=0; n<anim.size(); n++) {
-                                    auto new_tilemap = new sp::Tilemap(scene->getRoot(), "tileset.png", 1.0, 1.0, 10, 10);
-                                    new_tilemap->render_data.order = -99;
-                                    if (n > 0) new_tilemap->render_data.type = sp::RenderData::Type::None;
-                                    animation_layers[anim.size()]->tilemaps.push_back(new_tilemap);
-                                }
-                            }
-                            for(size_t n=0; n<anim.size(); n++) {
-                                animation_layers[anim.size()]->tilemaps[n]->setTile(tp, anim[n], sp::Tilemap::Collision::Open);
-                            }
-                        } else {
-                            tilemap->setTile(tp, tile_nr, maintilemap ? tile_collision[tile_nr] : sp::Tilemap::Collision::Open);
-                        }
-
-                        switch(tile_special[tile_nr]) {
-                        case TileSpecial::None: break;
-                        case TileSpecial::SpikeDown: new KillZone(scene->getRoot(), sp::Vector2d(tp) + sp::Vector2d(0.5, 0.1), sp::Vector2d(0.8, 0.2)); break;
-                        case TileSpecial::SpikeUp: new KillZone(scene->getRoot(), sp::Vector2d(tp) + sp::Vector2d(0.5, 0.9), sp::Vector2d(0.8, 0.2)); break;
-                        case TileSpecial::SpikeLeft: new KillZone(scene->getRoot(), sp::Vector2d(tp) + sp::Vector2d(0.1, 0.5), sp::Vector2d(0.2, 0.8)); break;
-                        case TileSpecial::SpikeRight: new KillZone(scene->getRoot(), sp::Vector2d(tp) + sp::Vector2d(0.9, 0.5), sp::Vector2d(0.2, 0.8)); break;
-                        case TileSpecial::Water: watermap.set(tp, true); break;
-                        case TileSpecial::Moss: mossmap.set(tp, true); break;
-                        }
-                    }
-                }
-            }
-            if (layer.find("properties") != layer.end()) {
-                for(auto& prop : layer["properties"]) {
-                    std::string name = prop["name"];
-                    if (name == "autohide" && bool(prop["value"])) {
-                        new HideLayerTrigger(tilemap, {sp::Vector2d(tile_min) - sp::Vector2d(0.5, 0.25), sp::Vector2d(tile_max - tile_min) + sp::Vector2d(2, 1.5)});
-                    }
-                    if (name == "z") {
-                        tilemap->render_data.order = int(prop["value"]);
-                    }
-                }
-            }
-        }
-        if (layer["type"] == "objectgroup") {
-            for(auto& obj : layer["objects"]) {
-                double x = obj["x"];
-                double y = obj["y"];
-                sp::Vector2d pos{x / 13.0, -y / 13.0 + 0.5};
-                std::string name = obj["name"];
-                if (name == "checkpoint") {
-                    auto cp = new Checkpoint(scene->getRoot());
-                    cp->setPosition(pos);
-                    cp->id = obj["id"];
-                } else if (name == "tapemeasure") {
-                    new Pickup(scene->getRoot(), pos, Pickup::Type::TapeMeasure, obj["id"]);
-                } else if (name == "climbingglove") {
-                    new Pickup(scene->getRoot(), pos, Pickup::Type::ClimbingGlove, obj["id"]);
-                } else if (name == "teleport") {
-                    new Pickup(scene->getRoot(), pos, Pickup::Type::Teleport, obj["id"]);
-                } else if (name == "diving") {
-                    new Pickup(scene->getRoot(), pos, Pickup::Type::DivingHelmet, obj["id"]);
-                } else if (name == "spider") {
-                    new Pickup(scene->getRoot(), pos, Pickup::Type::RadioactiveSpider, obj["id"]);
-                } else if (name == "fallingblock") {
-                    new FallingBlock(scene->getRoot(), pos);
-                } else if (name == "start") {
-                    start_position = pos;
-#ifdef DEBUG
-                } else if (name == "quickstart") {
-                    intro_state = IntroState::Crashed;
-                    player = new Player(scene->getRoot());
-                    player->setPosition(pos);
-                    player->can_hang = true;
-                    player->can_teleport = true;
-                    player->can_dive = true;
-                    player->can_rope = true;
-                    player->death_line->render_data.type = sp::RenderData::Type::Normal;
-                    start_position = pos;
-#endif
-                } else if (name == "plane") {
-                    plane_start_position = pos;
-                } else if (name == "sign") {
-                    auto mst = new MessageSignTrigger(scene->getRoot());
-                    mst->setPosition(pos);
-                    for(auto& prop : obj["properties"]) {
-                        std::string prop_name = prop["name"];
-                        if (prop_name == "text")
-                            mst->message = prop["value"];
-                        if (prop_name == "secret" && bool(prop["value"]))
-                            mst->secret = true;
-                    }
-                } else if (name == "secret") {
-                    auto st = new SecretTrigger(scene->getRoot());
-                    st->setPosition(pos);
-                    for(auto& prop : obj["properties"]) {
-                        std::string prop_name = prop["name"];
-                        if (prop_name == "code")
-                            st->code = prop["value"];
-                        if (prop_name == "key")
-                            st->key = prop["value"];
-                    }
-                } else if (name == "secret2") {
-                    for(auto& prop : obj["properties"]) {
-                        std::string prop_name = prop["name"];
-                        if (prop_name == "key")
-                            secret_target[prop["value"]] = pos - sp::Vector2d(0, 0.5);
-                    }
-                } else if (name == "normalexit") {
-                    auto se = new NormalExit(scene->getRoot());
-                    se->setPosition(pos);
-                } else if (name == "secretexit") {
-                    auto se = new SecretExit(scene->getRoot());
-                    se->setPosition(pos);
-                }
-            }
-        }
+public:
+    TriggerTicker(sp::P<sp::Node> parent)
+    : WorldNode(parent)
+    {
     }
 
-    auto savedata = sp::io::loadFileContents(sp::io::preferencePath() + "progress.save");
-    auto save_json = nlohmann::json::parse(savedata, nullptr, false, false);
-    if (!save_json.is_discarded()) {
-        if (!player) {
-            player = new Player(scene->getRoot());
-            for(auto node : sp::Scene::get("MAIN")->getRoot()->getChildren()) {
-                auto spi = dynamic_cast<SaveProgressInterface*>(*node);
-                if (spi) spi->load(save_json);
-            }
-            if (player->checkpoint)
-                player->setPosition(player->checkpoint->getPosition2D());
-        }
+    void onFixedUpdate() override
+    {
+        ProfileZone zone("triggers");
+        if (world->player)
+            world->trigger_grid.update(world->player->getPosition2D());
+        else
+            world->trigger_grid.update({});
     }
+};
 
-    if (player) {
-        auto plane = new Plane(scene->getRoot());
-        plane->setRotation((start_position - plane_start_position).angle());
+//Runs the updates of the nodes that are awake in the tick scheduler. Created right after the InputTicker and TriggerTicker.
+class SchedulerTicker : public WorldNode
+{
+public:
+    SchedulerTicker(sp::P<sp::Node> parent)
+    : WorldNode(parent)
+    {
+    }
+
+    void onUpdate(float delta) override
+    {
+        ProfileZone zone("scheduled nodes");
+        world->tick_scheduler.update(delta);
+    }
+
+    void onFixedUpdate() override
+    {
+        ProfileZone zone("scheduled nodes");
+        world->tick_scheduler.fixedUpdate();
+    }
+};
+
+//Materializes tiles, spikes and small objects of the level in chunks around the camera and the player.
+//Everything else stays as plain data in the LevelData, so the node count does not grow with the map size.
+class WorldStreamer : public WorldNode, public SaveProgressInterface
+{
+public:
+    static constexpr int chunk_size = 16;
+    static constexpr int load_radius = 2;
+    static constexpr int unload_radius = 3;
+
+    WorldStreamer(sp::P<sp::Node> parent)
+    : WorldNode(parent)
+    {
+        world->registerSaveProgress(this);
+    }
+
+    void addTile(sp::P<sp::Tilemap> tilemap, sp::Vector2i position, int index, sp::Tilemap::Collision collision)
+    {
+        getChunk(chunkOf(position)).tiles.push_back({tilemap, position, index, collision});
+    }
+
+    void addAnimatedTile(sp::Vector2i position, int tile)
+    {
+        if (!tile_animator)
+            tile_animator = new TileAnimator(getParent());
+        getChunk(chunkOf(position)).animated_tiles.push_back({position, tile});
+    }
+
+    void addSolidTile(sp::Vector2i position)
+    {
+        solid_tiles.push_back(position);
+    }
+
+    void addSpike(sp::Vector2i position, LevelData::TileSpecial special)
+    {
+        getChunk(chunkOf(position)).spikes.push_back({position, special});
+    }
+
+    void addObject(const LevelData::Object& obj, sp::Vector2d position)
+    {
+        getChunk(chunkOf({int(std::floor(position.x)), int(std::floor(position.y))})).objects.push_back({&obj, position});
+    }
+
+    //Merge rows of spikes with the same direction into a single kill zone, which saves a lot of sensors
+    //on spike heavy sections. Rows never cross a chunk border, so they can still be streamed per chunk.
+    void mergeSpikes()
+    {
+        for(auto& it : chunks) {
+            auto& spikes = it.second.spikes;
+            std::sort(spikes.begin(), spikes.end(), [](const SpikeEntry& a, const SpikeEntry& b) {
+                if (a.special != b.special)
+                    return a.special < b.special;
+                if (KillZone::isHorizontalSpike(a.special))
+                    return std::make_pair(a.position.y, a.position.x) < std::make_pair(b.position.y, b.position.x);
+                return std::make_pair(a.position.x, a.position.y) < std::make_pair(b.position.x, b.position.y);
+            });
+            std::vector<SpikeEntry> merged;
+            for(auto& spike : spikes) {
+                if (!merged.empty() && merged.back().special == spike.special) {
+                    auto& run = merged.back();
+                    auto step = KillZone::isHorizontalSpike(spike.special) ? sp::Vector2i(1, 0) : sp::Vector2i(0, 1);
+                    if (run.position + step * (run.length - 1) == spike.position)
+                        continue; //Same spike on multiple layers
+                    if (run.position + step * run.length == spike.position) {
+                        run.length++;
+                        continue;
+                    }
+                }
+                merged.push_back(spike);
+            }
+            spikes = std::move(merged);
+        }
+    }
+
+    //Cover the connected regions of solid tiles with rectangles, see buildSolidRegions. Regions are not cut at chunk
+    //borders, so walls stay seamless over them. A region is loaded while any chunk holding one of its tiles is loaded.
+    void mergeSolidTiles()
+    {
+        for(auto& region : buildSolidRegions(solid_tiles)) {
+            int index = int(solid_regions.size());
+            solid_regions.push_back({std::move(region.areas), {}, 0});
+            for(auto tile : region.tiles) {
+                auto& chunk = getChunk(chunkOf(tile));
+                if (chunk.solid_regions.empty() || chunk.solid_regions.back() != index)
+                    chunk.solid_regions.push_back(index);
+            }
+        }
+        solid_tiles.clear();
+        solid_tiles.shrink_to_fit();
+    }
+
+    //Streaming follows the player in fixed ticks, so chunks load on the same tick at any game speed and replays
+    //collide with the same tiles headless as live. The camera follows the player per frame, so it is only used during the intro.
+    void onFixedUpdate() override
+    {
+        if (world->player)
+            streamAround(world->player->getPosition2D());
+        else if (world->camera)
+            streamAround(world->camera->getPosition2D());
+    }
+
+    //Make sure the area around a position exists right now, used when the player jumps to a far away location.
+    void ensureLoaded(sp::Vector2d position)
+    {
+        auto center = chunkOf({int(std::floor(position.x)), int(std::floor(position.y))});
+        for(int y=-load_radius; y<=load_radius; y++)
+            for(int x=-load_radius; x<=load_radius; x++)
+                loadChunk(center + sp::Vector2i(x, y));
+    }
+
+    void streamAround(sp::Vector2d position)
+    {
+        ProfileZone zone("streaming");
+        auto center = chunkOf({int(std::floor(position.x)), int(std::floor(position.y))});
+        if (has_streamed && center == last_center_chunk)
+            return;
+        has_streamed = true;
+        last_center_chunk = center;
+
+        for(auto& it : chunks) {
+            if (it.second.loaded && chunkDistance(it.second.position, center) > unload_radius)
+                unloadChunk(it.second);
+        }
+        for(int y=-load_radius; y<=load_radius; y++)
+            for(int x=-load_radius; x<=load_radius; x++)
+                loadChunk(center + sp::Vector2i(x, y));
+    }
+
+    void save(nlohmann::json& json) override {
+        //Our state contains the progress of objects that are currently not loaded.
+        for(auto& it : persistent_state.items())
+            if (isStreamedKey(it.key()))
+                json[it.key()] = it.value();
+    }
+    void load(nlohmann::json& json) override {
+        //Only keep the progress of streamed objects, everything else in the save belongs to resident nodes.
+        persistent_state = nlohmann::json::object();
+        for(auto& it : json.items())
+            if (isStreamedKey(it.key()))
+                persistent_state[it.key()] = it.value();
+    }
+
+    //Progress of all streamed objects, both loaded and not.
+    nlohmann::json snapshotState()
+    {
+        nlohmann::json state = persistent_state;
+        for(auto& it : chunks) {
+            for(auto node : it.second.nodes) {
+                auto spi = dynamic_cast<SaveProgressInterface*>(*node);
+                if (spi) spi->save(state);
+            }
+        }
+        return state;
+    }
+
+    //Forget all progress and unload everything, the next streamAround spawns objects as they are in a new game.
+    void reset()
+    {
+        for(auto& it : chunks)
+            if (it.second.loaded)
+                unloadChunk(it.second, false);
+        persistent_state = nlohmann::json();
+        has_streamed = false;
+    }
+
+    //Throw away all streamed objects and stream them in again from the given progress.
+    void restoreState(const nlohmann::json& state, sp::Vector2d player_position)
+    {
+        for(auto& it : chunks)
+            if (it.second.loaded)
+                unloadChunk(it.second, false);
+        persistent_state = state;
+        has_streamed = false;
+        streamAround(player_position);
+    }
+
+    //Shared with other worlds simulating the same level, it is not changed after loading.
+    std::shared_ptr<const LevelData> level;
+
+private:
+    struct TileEntry {
+        sp::P<sp::Tilemap> tilemap;
+        sp::Vector2i position;
+        int index;
+        sp::Tilemap::Collision collision;
+    };
+    struct AnimatedTileEntry {
+        sp::Vector2i position;
+        int tile;
+    };
+    struct SpikeEntry {
+        sp::Vector2i position;
+        LevelData::TileSpecial special;
+        int length = 1;
+    };
+    struct ObjectEntry {
+        const LevelData::Object* object;
+        sp::Vector2d position;
+    };
+    struct Chunk {
+        sp::Vector2i position;
+        bool loaded = false;
+        std::vector<TileEntry> tiles;
+        std::vector<AnimatedTileEntry> animated_tiles;
+        std::vector<SpikeEntry> spikes;
+        std::vector<int> solid_regions;
+        std::vector<ObjectEntry> objects;
+        sp::PList<sp::Node> nodes;
+    };
+    struct SolidRegionEntry {
+        std::vector<sp::Rect2i> areas;
+        sp::PList<sp::Node> nodes;
+        int loaded_chunks; //a chunk that lists the region more than once counts that many times
+    };
+
+    static sp::Vector2i chunkOf(sp::Vector2i tile)
+    {
+        return {int(std::floor(double(tile.x) / chunk_size)), int(std::floor(double(tile.y) / chunk_size))};
+    }
+
+    static uint64_t chunkKey(sp::Vector2i chunk)
+    {
+        return (uint64_t(uint32_t(chunk.x)) << 32) | uint64_t(uint32_t(chunk.y));
+    }
+
+    //Progress keys written by the objects that spawnObject creates with a SaveProgressInterface.
+    static bool isStreamedKey(const std::string& key)
+    {
+        return key.compare(0, 7, "pickup_") == 0;
+    }
+
+    static int chunkDistance(sp::Vector2i a, sp::Vector2i b)
+    {
+        return std::max(std::abs(a.x - b.x), std::abs(a.y - b.y));
+    }
+
+    Chunk& getChunk(sp::Vector2i position)
+    {
+        auto& chunk = chunks[chunkKey(position)];
+        chunk.position = position;
+        return chunk;
+    }
+
+    void loadChunk(sp::Vector2i position)
+    {
+        auto it = chunks.find(chunkKey(position));
+        if (it == chunks.end() || it->second.loaded)
+            return;
+        auto& chunk = it->second;
+        chunk.loaded = true;
+
+        for(auto& tile : chunk.tiles)
+            tile.tilemap->setTile(tile.position, tile.index, tile.collision);
+        for(auto& tile : chunk.animated_tiles)
+            tile_animator->addCell(tile.position, tile.tile, level->getTile(tile.tile).animation);
+        for(int index : chunk.solid_regions) {
+            auto& region = solid_regions[index];
+            if (region.loaded_chunks++ == 0) {
+                for(auto& area : region.areas)
+                    region.nodes.add(new SolidArea(getParent(), area));
+            }
+        }
+        for(auto& spike : chunk.spikes)
+            chunk.nodes.add(spawnSpike(spike));
+        for(auto& entry : chunk.objects) {
+            auto node = spawnObject(*entry.object, entry.position);
+            if (!node)
+                continue;
+            chunk.nodes.add(node);
+            auto spi = dynamic_cast<SaveProgressInterface*>(*node);
+            if (spi) spi->load(persistent_state);
+        }
+    }
+
+    void unloadChunk(Chunk& chunk, bool keep_progress=true)
+    {
+        chunk.loaded = false;
+        for(auto& tile : chunk.tiles)
+            tile.tilemap->setTile(tile.position, -1, sp::Tilemap::Collision::Open);
+        for(auto& tile : chunk.animated_tiles)
+            tile_animator->removeCell(tile.position, tile.tile);
+        for(int index : chunk.solid_regions) {
+            auto& region = solid_regions[index];
+            if (--region.loaded_chunks == 0) {
+                for(auto node : region.nodes)
+                    node.destroy();
+                region.nodes.clear();
+            }
+        }
+        for(auto node : chunk.nodes) {
+            auto spi = dynamic_cast<SaveProgressInterface*>(*node);
+            if (spi && keep_progress) spi->save(persistent_state);
+            node.destroy();
+        }
+        chunk.nodes.clear();
+    }
+
+    sp::P<sp::Node> spawnSpike(const SpikeEntry& spike)
+    {
+        return new KillZone(getParent(), spike.position, spike.special, spike.length);
+    }
+
+    sp::P<sp::Node> spawnObject(const LevelData::Object& obj, sp::Vector2d pos)
+    {
+        if (obj.name == "tapemeasure") {
+            return new Pickup(getParent(), pos, Pickup::Type::TapeMeasure, obj.id);
+        } else if (obj.name == "climbingglove") {
+            return new Pickup(getParent(), pos, Pickup::Type::ClimbingGlove, obj.id);
+        } else if (obj.name == "teleport") {
+            return new Pickup(getParent(), pos, Pickup::Type::Teleport, obj.id);
+        } else if (obj.name == "diving") {
+            return new Pickup(getParent(), pos, Pickup::Type::DivingHelmet, obj.id);
+        } else if (obj.name == "spider") {
+            return new Pickup(getParent(), pos, Pickup::Type::RadioactiveSpider, obj.id);
+        } else if (obj.name == "fallingblock") {
+            auto fb = new FallingBlock(getParent(), pos);
+            world->registerSnapshot(fb, obj.id);
+            return fb;
+        } else if (obj.name == "sign") {
+            auto mst = new MessageSignTrigger(getParent(), pos);
+            mst->message = obj.getProperty("text");
+            mst->secret = obj.getProperty("secret") == "true";
+            return mst;
+        } else if (obj.name == "normalexit") {
+            auto se = new NormalExit(getParent());
+            se->setPosition(pos);
+            return se;
+        }
+        return nullptr;
+    }
+
+    std::unordered_map<uint64_t, Chunk> chunks;
+    std::vector<sp::Vector2i> solid_tiles;
+    std::vector<SolidRegionEntry> solid_regions;
+    sp::P<TileAnimator> tile_animator;
+    nlohmann::json persistent_state;
+    bool has_streamed = false;
+    sp::Vector2i last_center_chunk;
+};
+
+sp::P<sp::Window> window;
+
+//Ends a profiler frame on every frame, and shows the profiler results on top of the game while toggled on.
+class ProfilerScene : public sp::Scene
+{
+public:
+    ProfilerScene()
+    : sp::Scene("PROFILER")
+    {
+    }
+
+    void onUpdate(float delta) override
+    {
+        profiler.endFrame();
+        if (profiler_binding.getDown()) {
+            if (overlay)
+                overlay.destroy();
+            else
+                overlay = sp::gui::Loader::load("gui/profiler.gui", "PROFILER");
+        }
+        if (overlay)
+            overlay->getWidgetWithID("REPORT")->setAttribute("caption", profiler.report());
+    }
+
+    sp::P<sp::gui::Widget> overlay;
+};
+
+//Runs a headless engine as fast as possible. The engine has no call to step a single tick, so the game speed is set
+//each frame such that the next frame runs ticks_per_frame fixed ticks, going by the real time of the last frame.
+//Frames then run ticks back to back.
+class HeadlessPacer
+{
+public:
+    void onFrame()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (has_last_frame) {
+            double frame_time = std::max(std::chrono::duration<double>(now - last_frame).count(), 0.0001);
+            double new_speed = std::clamp(ticks_per_frame * sp::Engine::fixed_update_delta / frame_time, 1.0, 1000000.0);
+            sp::Engine::getInstance()->setGameSpeed(float(new_speed));
+        }
+        last_frame = now;
+        has_last_frame = true;
+    }
+
+private:
+    static constexpr int ticks_per_frame = 100;
+    std::chrono::steady_clock::time_point last_frame;
+    bool has_last_frame = false;
+};
+
+//Why the simulation of a world is done, checked after every fixed tick. Empty while it still runs.
+static sp::string simulationEndReason(sp::P<World> world, int tick_limit)
+{
+    if (!world->reached_ending.empty())
+        return "ending";
+    if (tick_limit > 0 && world->simulation_tick >= tick_limit)
+        return "tick limit";
+    if (world->input_mode == InputMode::Playback && world->input_replay.isFinished() && !world->message_visible)
+        return "replay finished";
+    return "";
+}
+
+//When waiting on a message nothing can advance the simulation anymore, so it is stopped instead of hanging.
+//Checked every frame, stalled_frames is kept by the caller.
+static bool simulationStalled(sp::P<World> world, int& stalled_frames)
+{
+    static constexpr int max_stalled_frames = 1000;
+    if (!world->message_visible) {
+        stalled_frames = 0;
+        return false;
+    }
+    stalled_frames++;
+    return stalled_frames > max_stalled_frames;
+}
+
+//Result of a simulation, as written by --result and in the report of --validate.
+static nlohmann::json simulationResult(sp::P<World> world, const sp::string& reason)
+{
+    nlohmann::json result;
+    result["reason"] = reason;
+    result["ticks"] = world->simulation_tick;
+    result["ending"] = world->reached_ending;
+    if (world->player) {
+        result["death_count"] = world->player->death_count;
+        result["tele_count"] = world->player->tele_count;
+        result["jump_count"] = world->player->jump_count;
+    }
+    int secrets = 0;
+    for(sp::P<SecretTrigger> st : world->getRoot()->getChildren())
+        if (st && st->finished)
+            secrets++;
+    result["secrets"] = secrets;
+    return result;
+}
+
+//Keeps track of the simulation of a world in headless mode, from a scene of its own.
+class HeadlessScene : public sp::Scene
+{
+public:
+    //A speed of 0 runs as fast as possible.
+    HeadlessScene(sp::P<World> world, int tick_limit, const sp::string& result_filename, float speed)
+    : sp::Scene("HEADLESS"), world(world), tick_limit(tick_limit), result_filename(result_filename), speed(speed)
+    {
+        sp::Engine::getInstance()->setGameSpeed(speed > 0.0f ? speed : 1.0f);
+    }
+
+    void onUpdate(float delta) override
+    {
+        if (speed <= 0.0f)
+            pacer.onFrame();
+        if (simulationStalled(world, stalled_frames))
+            finish("stalled");
+    }
+
+    void onFixedUpdate() override
+    {
+        auto reason = simulationEndReason(world, tick_limit);
+        if (!reason.empty())
+            finish(reason);
+    }
+
+    void finish(const sp::string& reason)
+    {
+        if (done)
+            return;
+        done = true;
+        LOG(Info, "Headless simulation finished:", reason, "after", world->simulation_tick, "ticks");
+        if (world->player)
+            LOG(Info, "deaths:", world->player->death_count, "teleports:", world->player->tele_count, "jumps:", world->player->jump_count, "ending:", world->reached_ending);
+        if (!result_filename.empty())
+            sp::io::saveFileContents(result_filename, simulationResult(world, reason).dump());
+        sp::Engine::getInstance()->shutdown();
+    }
+
+    sp::P<World> world;
+    int tick_limit;
+    sp::string result_filename;
+    float speed;
+    HeadlessPacer pacer;
+    int stalled_frames = 0;
+    bool done = false;
+};
+
+World::World(const sp::string& name, bool interactive, InputMode input_mode)
+: sp::Scene(name), interactive(interactive), input_mode(input_mode)
+{
+}
+
+World::~World()
+{
+    //The message box lives in the GUI scene, so it does not go away together with our nodes.
+    visible_message.destroy();
+}
+
+void World::saveGame()
+{
+    if (!interactive || practice_mode)
+        return;
+    ProfileZone zone("World::saveGame");
+    nlohmann::json json;
+    saveProgress(json);
+    progress_store.update(json);
+}
+
+void World::saveProgress(nlohmann::json& json)
+{
+    removeDestroyedSaveParticipants();
+    for(auto& participant : save_participants)
+        participant.progress->save(json);
+}
+
+void World::loadProgress(nlohmann::json& json)
+{
+    removeDestroyedSaveParticipants();
+    for(auto& participant : save_participants)
+        participant.progress->load(json);
+}
+
+void World::removeDestroyedSaveParticipants()
+{
+    save_participants.erase(std::remove_if(save_participants.begin(), save_participants.end(), [](const SaveParticipant& participant) {
+        return !participant.node;
+    }), save_participants.end());
+}
+
+void World::registerSnapshot(sp::P<WorldNode> node, uint32_t key)
+{
+    //Streamed objects register each time they are spawned, so clean up before the list grows.
+    if (snapshot_participants.size() == snapshot_participants.capacity())
+        removeDestroyedSnapshotParticipants();
+    snapshot_participants.push_back({key, node});
+}
+
+void World::registerCheckpoint(sp::P<Checkpoint> checkpoint)
+{
+    checkpoint->slot = checkpoint_index.add(checkpoint->getPosition2D());
+    checkpoints.push_back(checkpoint);
+}
+
+sp::P<Checkpoint> World::getCheckpoint(int slot)
+{
+    if (slot == CheckpointIndex::none)
+        return nullptr;
+    return checkpoints[slot];
+}
+
+sp::P<Checkpoint> World::findCheckpoint(int id)
+{
+    for(auto& checkpoint : checkpoints) {
+        if (checkpoint && checkpoint->id == id)
+            return checkpoint;
+    }
+    return nullptr;
+}
+
+bool World::snapshot(WorldSnapshot& snapshot)
+{
+    if (!player || message_visible || intro_state != IntroState::Done)
+        return false;
+    removeDestroyedSnapshotParticipants();
+    SnapshotWriter writer(snapshot);
+    writer.write(camera->getPosition2D());
+    writer.write(player->getPosition2D());
+    writer.writeString(SaveStore::encode(world_streamer->snapshotState()));
+    for(auto& participant : snapshot_participants) {
+        writer.beginEntry(participant.key);
+        participant.node->snapshot(writer);
+        writer.endEntry();
+    }
+    return true;
+}
+
+void World::restore(const WorldSnapshot& snapshot)
+{
+    SnapshotReader reader(snapshot);
+    auto camera_position = reader.read<sp::Vector2d>();
+    auto player_position = reader.read<sp::Vector2d>();
+    nlohmann::json streamed_state;
+    if (!SaveStore::decode(reader.readString(), streamed_state) || reader.error) {
+        LOG(Error, "Invalid world snapshot");
+        return;
+    }
+    camera->setPosition(camera_position);
+    //Streaming in the area first gives the objects there a node to restore their state onto.
+    world_streamer->restoreState(streamed_state, player_position);
+
+    removeDestroyedSnapshotParticipants();
+    std::unordered_map<uint32_t, sp::P<WorldNode>> nodes;
+    for(auto& participant : snapshot_participants)
+        nodes[participant.key] = participant.node;
+    uint32_t key;
+    while(reader.nextEntry(key)) {
+        auto it = nodes.find(key);
+        if (it != nodes.end())
+            it->second->restore(reader);
+    }
+    if (player->checkpoint)
+        player->checkpoint->animationPlay("Active");
+}
+
+void World::removeDestroyedSnapshotParticipants()
+{
+    snapshot_participants.erase(std::remove_if(snapshot_participants.begin(), snapshot_participants.end(), [](const SnapshotParticipant& participant) {
+        return !participant.node;
+    }), snapshot_participants.end());
+}
+
+void World::showMessage(sp::string message, std::function<void()> func)
+{
+    visible_message = loadGui("gui/msgbox.gui", "MSGBOX");
+    if (visible_message)
+        visible_message->getWidgetWithID("MSG")->setAttribute("caption", message);
+    message_visible = true;
+    //Gameplay nodes freeze themselves while a message is visible, so other worlds keep running.
+    if (interactive)
+        sp::Engine::getInstance()->setGameSpeed(0.0);
+    post_message_function = func;
+}
+
+void World::hideMessage()
+{
+    message_visible = false;
+    visible_message.destroy();
+    if (interactive)
+        sp::Engine::getInstance()->setGameSpeed(game_speed);
+}
+
+//Messages are dismissed while the game is paused, so this is checked every frame instead of every tick.
+bool World::messageDismissRequested()
+{
+    if (input_mode == InputMode::Playback)
+        return input_replay.playbackMessageDismiss();
+    bool pressed = jump_binding.getDown();
+    if (pressed && input_mode == InputMode::Record)
+        input_replay.recordMessageDismiss();
+    return pressed;
+}
+
+void World::playSound(const sp::string& name)
+{
+    if (interactive)
+        sp::audio::Sound::play(name);
+}
+
+void World::playMusic(const sp::string& name)
+{
+    if (interactive)
+        sp::audio::Music::play(name);
+}
+
+sp::P<sp::gui::Widget> World::loadGui(const sp::string& filename, const sp::string& name)
+{
+    if (!interactive)
+        return nullptr;
+    ProfileZone zone("gui load");
+    return sp::gui::Loader::load(filename, name);
+}
+
+//Make sure the area around a position exists right now, used when the player jumps to a far away location.
+void World::streamAround(sp::Vector2d position)
+{
+    if (world_streamer)
+        world_streamer->ensureLoaded(position);
+}
+
+std::shared_ptr<const LevelData> World::loadLevel()
+{
+    ProfileZone zone("load level");
+    auto level = std::make_shared<LevelData>();
+    if (!level->load("map.json", "map.bin")) {
+        LOG(Error, "Failed to load level");
+        return nullptr;
+    }
+    return level;
+}
+
+void World::create(std::shared_ptr<const LevelData> level)
+{
+    ProfileZone zone("World::create");
+    camera = new sp::Camera(getRoot());
+    camera->setOrtographic({5, 7});
+    setDefaultCamera(camera);
+    new InputTicker(getRoot());
+    new TriggerTicker(getRoot());
+    new SchedulerTicker(getRoot());
+    layer_fader = new LayerFader(getRoot());
+
+    world_streamer = new WorldStreamer(getRoot());
+    tile_flags.clear();
+    if (!level)
+        level = loadLevel();
+    if (!level)
+        return;
+    world_streamer->level = level;
+
+    buildLayers(*level);
+    placeObjects(*level);
+
+    for(auto node : getRoot()->getChildren())
+        level_nodes.add(node);
+    start();
+}
+
+//Tilemaps of all layers, with their tiles, spikes and solid areas handed to the streamer.
+void World::buildLayers(const LevelData& level)
+{
+    ProfileZone zone("build layers");
+    for(auto& layer : level.layers) {
+        auto tilemap = new sp::Tilemap(getRoot(), "tileset.png", 1.0, 1.0, 10, 10);
+        tilemap->render_data.order = layer.z;
+        bool maintilemap = layer.name == "MAIN";
+        tilemap_by_name[layer.name] = tilemap;
+        tilemap->setTilemapSpacingMargin(0.01, 0.0);
+        sp::Vector2i tile_min{99999,99999};
+        sp::Vector2i tile_max{-99999,-99999};
+        for(auto& chunk : layer.chunks) {
+            for(auto p : sp::Rect2i{{0, 0}, chunk.size}) {
+                int tile_nr = chunk.data[p.x + p.y * chunk.size.x];
+                if (tile_nr >= 0) {
+                    auto tp = sp::Vector2i{p.x + chunk.position.x, - p.y - chunk.position.y - 1};
+                    tile_min.x = std::min(tile_min.x, tp.x);
+                    tile_min.y = std::min(tile_min.y, tp.y);
+                    tile_max.x = std::max(tile_max.x, tp.x);
+                    tile_max.y = std::max(tile_max.y, tp.y);
+                    const auto& tile = level.getTile(tile_nr);
+                    if (!tile.animation.empty()) {
+                        world_streamer->addAnimatedTile(tp, tile_nr);
+                    } else if (maintilemap && tile.solid && merged_tile_collision) {
+                        tile_flags.add(tp, TileFlagGrid::Solid);
+                        world_streamer->addTile(tilemap, tp, tile_nr, sp::Tilemap::Collision::Open);
+                        world_streamer->addSolidTile(tp);
+                    } else {
+                        if (maintilemap && tile.solid)
+                            tile_flags.add(tp, TileFlagGrid::Solid);
+                        world_streamer->addTile(tilemap, tp, tile_nr, (maintilemap && tile.solid) ? sp::Tilemap::Collision::Solid : sp::Tilemap::Collision::Open);
+                    }
+
+                    switch(tile.special) {
+                    case LevelData::TileSpecial::None: break;
+                    case LevelData::TileSpecial::SpikeDown:
+                    case LevelData::TileSpecial::SpikeUp:
+                    case LevelData::TileSpecial::SpikeLeft:
+                    case LevelData::TileSpecial::SpikeRight:
+                        tile_flags.add(tp, TileFlagGrid::Spike);
+                        world_streamer->addSpike(tp, tile.special);
+                        break;
+                    case LevelData::TileSpecial::Water: tile_flags.add(tp, TileFlagGrid::Water); break;
+                    case LevelData::TileSpecial::Moss: tile_flags.add(tp, TileFlagGrid::Moss); break;
+                    }
+                }
+            }
+        }
+        if (layer.autohide) {
+            new HideLayerTrigger(tilemap, {sp::Vector2d(tile_min) - sp::Vector2d(0.5, 0.25), sp::Vector2d(tile_max - tile_min) + sp::Vector2d(2, 1.5)});
+        }
+    }
+
+    world_streamer->mergeSpikes();
+    world_streamer->mergeSolidTiles();
+}
+
+void World::placeObjects(const LevelData& level)
+{
+    ProfileZone zone("place objects");
+    for(auto& obj : level.objects) {
+        sp::Vector2d pos{obj.position.x / 13.0, -obj.position.y / 13.0 + 0.5};
+        if (obj.name == "checkpoint") {
+            auto cp = new Checkpoint(getRoot());
+            cp->setPosition(pos);
+            cp->id = obj.id;
+            registerCheckpoint(cp);
+            registerSnapshot(cp, obj.id);
+        } else if (obj.name == "tapemeasure" || obj.name == "climbingglove" || obj.name == "teleport" || obj.name == "diving" || obj.name == "spider"
+                || obj.name == "fallingblock" || obj.name == "sign" || obj.name == "normalexit") {
+            world_streamer->addObject(obj, pos);
+        } else if (obj.name == "start") {
+            start_position = pos;
+#ifdef DEBUG
+        } else if (obj.name == "quickstart") {
+            quickstart = true;
+            start_position = pos;
+#endif
+        } else if (obj.name == "plane") {
+            initial_plane_start_position = pos;
+        } else if (obj.name == "secret") {
+            auto st = new SecretTrigger(getRoot(), pos);
+            st->code = obj.getProperty("code");
+            st->key = obj.getProperty("key");
+            registerSnapshot(st, obj.id);
+        } else if (obj.name == "secret2") {
+            secret_target[obj.getProperty("key")] = pos - sp::Vector2d(0, 0.5);
+        } else if (obj.name == "secretexit") {
+            auto se = new SecretExit(getRoot());
+            se->setPosition(pos);
+        }
+    }
+}
+
+void World::reset(InputMode input_mode)
+{
+    this->input_mode = input_mode;
+    input_replay.clear();
+    simulation_tick = 0;
+    reached_ending.clear();
+    practice_snapshot = {};
+    if (message_visible)
+        hideMessage();
+    post_message_function = nullptr;
+
+    //Streamed nodes are unloaded by the streamer itself, so it knows their chunks are gone.
+    world_streamer->reset();
+    std::vector<sp::P<sp::Node>> play_nodes;
+    for(auto node : getRoot()->getChildren()) {
+        if (!level_nodes.has(node))
+            play_nodes.push_back(node);
+    }
+    for(auto& node : play_nodes)
+        node.destroy();
+    for(auto& it : tilemap_by_name)
+        it.second->render_data.color.a = 1.0f;
+    for(auto node : level_nodes) {
+        sp::P<WorldNode> world_node = node;
+        if (world_node)
+            world_node->restart();
+    }
+    start();
+}
+
+//Place the player and the plane for the start of a game, on a level that is already built.
+void World::start()
+{
+    ProfileZone zone("World::start");
+    intro_state = IntroState::WaitForInitialStart;
+    plane_start_position = initial_plane_start_position;
+#ifdef DEBUG
+    if (quickstart) {
+        intro_state = IntroState::Crashed;
+        player = new Player(getRoot());
+        player->setPosition(start_position);
+        player->can_hang = true;
+        player->can_teleport = true;
+        player->can_dive = true;
+        player->can_rope = true;
+        player->death_line->render_data.type = sp::RenderData::Type::Normal;
+    }
+#endif
+
+    //Simulations, recordings and replays always start from a fresh game.
+    bool fresh_game = !interactive || input_mode != InputMode::Live;
+    if (!fresh_game && progress_store.hasProgress()) {
+        if (!player) {
+            auto save_json = progress_store.getProgress();
+            player = new Player(getRoot());
+            loadProgress(save_json);
+            if (player->checkpoint)
+                player->setPosition(player->checkpoint->getPosition2D());
+        }
+    }
+
+    if (player) {
+        auto plane = new Plane(getRoot());
+        plane->setRotation((start_position - plane_start_position).angle());
         plane->setPosition(start_position);
         plane->engine_emitter.destroy();
         intro_state = IntroState::Done;
@@ -1658,21 +2994,147 @@ void createWorld()
         pe->setRotation(-plane->getRotation2D());
 
         camera->setPosition(player->getPosition2D());
-        sp::audio::Music::play("music/A Tale of Wind - MP3.ogg");
+        playMusic("music/A Tale of Wind - MP3.ogg");
     } else {
-        auto plane = new Plane(scene->getRoot());
+        auto plane = new Plane(getRoot());
         plane->setPosition(plane_start_position);
         plane->setRotation((start_position - plane_start_position).angle());
         camera->setPosition(plane_start_position);
     }
+    world_streamer->streamAround(player ? player->getPosition2D() : camera->getPosition2D());
+}
+
+//Compares saving through the registry of save participants with checking every node of the world, like saving used to do.
+int benchmarkSave(int iterations)
+{
+    sp::P<World> world = new World("MAIN", false, InputMode::Live);
+    world->create();
+
+    int node_count = 0;
+    int participant_count = 0;
+    auto scan_start = std::chrono::steady_clock::now();
+    for(int n=0; n<iterations; n++) {
+        nlohmann::json json;
+        for(auto node : world->getRoot()->getChildren()) {
+            auto spi = dynamic_cast<SaveProgressInterface*>(*node);
+            if (spi) spi->save(json);
+            if (n == 0) {
+                node_count++;
+                if (spi) participant_count++;
+            }
+        }
+    }
+    auto registry_start = std::chrono::steady_clock::now();
+    for(int n=0; n<iterations; n++) {
+        nlohmann::json json;
+        world->saveProgress(json);
+    }
+    auto registry_end = std::chrono::steady_clock::now();
+
+    auto us = [iterations](auto duration) { return double(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()) / iterations; };
+    LOG(Info, "Save of", participant_count, "participants among", node_count, "nodes, average of", iterations, "runs");
+    LOG(Info, "Scanning all nodes:", us(registry_start - scan_start), "us");
+    LOG(Info, "Registry:", us(registry_end - registry_start), "us");
+    return 0;
+}
+
+//Average number of nodes the tick scheduler of the world visited per update.
+void logTickStats(sp::P<World> world)
+{
+    if (!world)
+        return;
+    auto average = [](const TickScheduler::Stats& stats) { return stats.runs > 0 ? double(stats.total_visited) / double(stats.runs) : 0.0; };
+    LOG(Info, "Scheduled nodes visited per frame:", average(world->tick_scheduler.getStats(TickScheduler::Update)),
+        "per fixed tick:", average(world->tick_scheduler.getStats(TickScheduler::FixedUpdate)));
 }
 
 int main(int argc, char** argv)
 {
+    if (argc == 4 && sp::string(argv[1]) == "--bake-level")
+        return LevelData::bakeFile(argv[2], argv[3]) ? 0 : 1;
+    if (argc >= 6 && sp::string(argv[1]) == "--pack-atlas")
+        return SpriteAtlas::pack(argv[2], argv[3], argv[4], std::vector<sp::string>(argv + 5, argv + argc)) ? 0 : 1;
+    if (argc == 4 && sp::string(argv[1]) == "--convert-save")
+        return SaveStore::convertFile(argv[2], argv[3]) ? 0 : 1;
+    if (argc >= 3 && sp::string(argv[1]) == "--validate") {
+        std::vector<sp::string> inputs;
+        int jobs = 0;
+        for(int n=3; n<argc; n++) {
+            if (sp::string(argv[n]) == "--jobs" && n + 1 < argc)
+                jobs = sp::stringutil::convert::toInt(argv[++n]);
+            else
+                inputs.push_back(argv[n]);
+        }
+        return validateReplays(argv[0], inputs, argv[2], jobs);
+    }
+
+    int headless_tick_limit = 0;
+    int benchmark_save_iterations = 0;
+    sp::string headless_result_filename;
+    InputMode input_mode = InputMode::Live;
+    InputReplay input_replay;
+    sp::string replay_filename;
+    sp::string trace_filename;
+    bool speed_set = false;
+    for(int n=1; n<argc; n++) {
+        sp::string arg = argv[n];
+        if (arg == "--trace" && n + 1 < argc)
+            trace_filename = argv[++n];
+        if (arg == "--merged-collision")
+            merged_tile_collision = true;
+        if (arg == "--headless")
+            headless = true;
+        if (arg == "--benchmark-save")
+            benchmark_save_iterations = 1000;
+        if (arg == "--ticks" && n + 1 < argc)
+            headless_tick_limit = sp::stringutil::convert::toInt(argv[++n]);
+        if (arg == "--result" && n + 1 < argc)
+            headless_result_filename = argv[++n];
+        if (arg == "--practice")
+            practice_mode = true;
+        if (arg == "--speed" && n + 1 < argc) {
+            game_speed = sp::stringutil::convert::toFloat(argv[++n]);
+            speed_set = true;
+        }
+        if (arg == "--record" && n + 1 < argc) {
+            input_mode = InputMode::Record;
+            replay_filename = argv[++n];
+        }
+        if (arg == "--replay" && n + 1 < argc) {
+            input_mode = InputMode::Playback;
+            replay_filename = argv[++n];
+        }
+    }
+    if (input_mode == InputMode::Playback && !input_replay.load(sp::io::loadFileContents(replay_filename))) {
+        LOG(Error, "Failed to load replay", replay_filename);
+        return 1;
+    }
+
+    if (!trace_filename.empty())
+        profiler.startTrace();
+
     sp::P<sp::Engine> engine = new sp::Engine();
 
     //Create resource providers, so we can load things.
     sp::io::ResourceProvider::createDefault();
+    sprite_atlas.load("atlas.json");
+
+    if (benchmark_save_iterations > 0)
+        return benchmarkSave(benchmark_save_iterations);
+
+    if (headless) {
+        //No window, GUI or audio, the engine just runs the fixed updates, as fast as possible unless a speed is given.
+        sp::P<World> world = new World("MAIN", false, input_mode);
+        world->input_replay = input_replay;
+        world->create();
+        new HeadlessScene(world, headless_tick_limit, headless_result_filename, speed_set ? game_speed : 0.0f);
+        engine->run();
+        LOG(Info, "Effect nodes created:", node_pool_stats.created, "reused:", node_pool_stats.reused);
+        logTickStats(world);
+        if (!trace_filename.empty())
+            profiler.saveTrace(trace_filename);
+        return 0;
+    }
 
     //Disable or enable smooth filtering by default, enabling it gives nice smooth looks, but disabling it gives a more pixel art look.
     sp::texture_manager.setDefaultSmoothFiltering(false);
@@ -1688,15 +3150,29 @@ int main(int argc, char** argv)
     new sp::gui::Scene(sp::Vector2d(320, 240));
 
     sp::P<sp::SceneGraphicsLayer> scene_layer = new sp::SceneGraphicsLayer(1);
-    scene_layer->addRenderPass(new sp::BasicNodeRenderPass());
+    scene_layer->addRenderPass(new SpriteBatchRenderPass());
 #ifdef DEBUG
     scene_layer->addRenderPass(new sp::CollisionRenderPass());
 #endif
     window->addLayer(scene_layer);
 
+    new ProfilerScene();
+
     sp::audio::Music::setVolume(50);
-    createWorld();
+    progress_store.open(sp::io::preferencePath() + "progress.save");
+    sp::P<World> world = new World("MAIN", true, input_mode);
+    world->input_replay = input_replay;
+    world->create();
     engine->run();
-
+    LOG(Info, "Effect nodes created:", node_pool_stats.created, "reused:", node_pool_stats.reused);
+    logTickStats(world);
+    if (!trace_filename.empty())
+        profiler.saveTrace(trace_filename);
+
+    //The world might have been reset during the session, so save the recording of the current one.
+    world = sp::Scene::get("MAIN");
+    if (input_mode == InputMode::Record && world && !sp::io::saveFileContents(replay_filename, world->input_replay.save()))
+        LOG(Error, "Failed to save replay", replay_filename);
+    progress_store.close();
     return 0;
 }
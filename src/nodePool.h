@@ -0,0 +1,74 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <sp2/scene/node.h>
+#include <vector>
+
+
+//Counts of all node pools together, to see how many nodes effects still allocate.
+struct NodePoolStats
+{
+    int created = 0;
+    int reused = 0;
+    int released = 0;
+};
+extern NodePoolStats node_pool_stats;
+
+//Base of short lived effect nodes that are recycled by a NodePool instead of destroyed.
+//A node in the pool stays in the scene, but hidden, and should not do anything in its updates.
+class PooledNode : public sp::Node
+{
+public:
+    PooledNode(sp::P<sp::Node> parent) : sp::Node(parent) {}
+
+    //Called every time the node is handed out by the pool, including the first time.
+    virtual void onAcquire() {}
+
+    bool isInPool() const { return in_pool; }
+
+private:
+    bool in_pool = false;
+
+    template<typename T> friend class NodePool;
+};
+
+//Free list of nodes of type T. Released nodes that got destroyed since, like together with their parent, are skipped.
+template<typename T> class NodePool
+{
+public:
+    sp::P<T> acquire(sp::P<sp::Node> parent)
+    {
+        sp::P<T> node;
+        while(!node && !free_nodes.empty()) {
+            sp::P<T> candidate = free_nodes.back();
+            free_nodes.pop_back();
+            node = candidate;
+        }
+        if (node) {
+            if (node->getParent() != parent)
+                node->setParent(parent);
+            node->in_pool = false;
+            node_pool_stats.reused++;
+        } else {
+            node = new T(parent);
+            node_pool_stats.created++;
+        }
+        node->onAcquire();
+        return node;
+    }
+
+    void release(sp::P<T> node)
+    {
+        if (!node || node->in_pool)
+            return;
+        node->in_pool = true;
+        node->render_data.type = sp::RenderData::Type::None;
+        free_nodes.push_back(node);
+        node_pool_stats.released++;
+    }
+
+private:
+    std::vector<sp::P<PooledNode>> free_nodes;
+};
+
+#endif//NODE_POOL_H
@@ -0,0 +1,123 @@
+#include "profiler.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdio>
+
+
+void Profiler::begin(const char* name)
+{
+    int parent = stack.empty() ? -1 : stack.back().zone;
+    stack.push_back({findZone(name, parent), Clock::now()});
+}
+
+void Profiler::end()
+{
+    auto now = Clock::now();
+    auto& open = stack.back();
+    auto& zone = zones[open.zone];
+    zone.frame_ms += std::chrono::duration<double, std::milli>(now - open.start).count();
+    zone.frame_count++;
+    if (tracing && trace.size() < max_trace_events) {
+        trace.push_back({open.zone,
+            std::chrono::duration_cast<std::chrono::microseconds>(open.start - epoch).count(),
+            std::chrono::duration_cast<std::chrono::microseconds>(now - open.start).count()});
+    }
+    stack.pop_back();
+}
+
+void Profiler::endFrame()
+{
+    auto now = Clock::now();
+    last_frame_ms = std::chrono::duration<double, std::milli>(now - frame_start).count();
+    frame_start = now;
+    if (tracing && trace.size() < max_trace_events)
+        trace.push_back({-1, std::chrono::duration_cast<std::chrono::microseconds>(now - epoch).count(), 0});
+
+    frame_number++;
+    bool new_window = frame_number % peak_frames == 0;
+    window_peak_frame_ms = std::max(window_peak_frame_ms, last_frame_ms);
+    if (new_window) {
+        peak_frame_ms = window_peak_frame_ms;
+        window_peak_frame_ms = 0.0;
+    }
+    for(auto& zone : zones) {
+        zone.last_ms = zone.frame_ms;
+        zone.last_count = zone.frame_count;
+        zone.frame_ms = 0.0;
+        zone.frame_count = 0;
+        zone.window_peak_ms = std::max(zone.window_peak_ms, zone.last_ms);
+        if (new_window) {
+            zone.peak_ms = zone.window_peak_ms;
+            zone.window_peak_ms = 0.0;
+        }
+    }
+}
+
+sp::string Profiler::report() const
+{
+    char line[128];
+    snprintf(line, sizeof(line), "frame %6.2f ms, peak %6.2f ms\n", last_frame_ms, peak_frame_ms);
+    sp::string result = line;
+    //Children follow their parent, in the order the zones were first seen.
+    std::vector<int> todo;
+    for(int n=int(zones.size())-1; n>=0; n--)
+        if (zones[n].parent == -1)
+            todo.push_back(n);
+    while(!todo.empty()) {
+        int index = todo.back();
+        todo.pop_back();
+        auto& zone = zones[index];
+        snprintf(line, sizeof(line), "%*s%-24s %6.2f %6.2f %4d\n", zone.depth * 2, "", zone.name, zone.last_ms, zone.peak_ms, zone.last_count);
+        result += line;
+        for(int n=int(zones.size())-1; n>index; n--)
+            if (zones[n].parent == index)
+                todo.push_back(n);
+    }
+    return result;
+}
+
+void Profiler::startTrace()
+{
+    tracing = true;
+    trace.clear();
+}
+
+bool Profiler::saveTrace(const sp::string& filename) const
+{
+    auto events = nlohmann::json::array();
+    for(auto& event : trace) {
+        if (event.zone < 0) {
+            events.push_back({{"name", "frame"}, {"ph", "i"}, {"s", "p"}, {"ts", event.start_us}, {"pid", 0}, {"tid", 0}});
+        } else {
+            events.push_back({{"name", zones[event.zone].name}, {"ph", "X"}, {"ts", event.start_us}, {"dur", event.duration_us}, {"pid", 0}, {"tid", 0}});
+        }
+    }
+    nlohmann::json json;
+    json["traceEvents"] = events;
+    json["displayTimeUnit"] = "ms";
+    if (!sp::io::saveFileContents(filename, json.dump())) {
+        LOG(Error, "Failed to write trace", filename);
+        return false;
+    }
+    if (trace.size() >= max_trace_events)
+        LOG(Warning, "Trace was cut off after", max_trace_events, "events");
+    LOG(Info, "Saved", trace.size(), "trace events to", filename);
+    return true;
+}
+
+int Profiler::findZone(const char* name, int parent)
+{
+    for(size_t n=0; n<zones.size(); n++) {
+        if (zones[n].name == name && zones[n].parent == parent)
+            return int(n);
+    }
+    Zone zone;
+    zone.name = name;
+    zone.parent = parent;
+    zone.depth = parent < 0 ? 0 : zones[parent].depth + 1;
+    zones.push_back(zone);
+    return int(zones.size()) - 1;
+}
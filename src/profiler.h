@@ -0,0 +1,80 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <sp2/string.h>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+
+//Times of named zones in the code, per frame. Zones nest, a zone is identified by its name and where it is nested,
+//so the same name under different parents shows up separately.
+//When tracing, every zone is also recorded as an event, to be saved as a Chrome trace (chrome://tracing or Perfetto).
+class Profiler
+{
+public:
+    //Names have to be string literals, zones are found by the pointer.
+    void begin(const char* name);
+    void end();
+    //Called once per frame, the zones of the frame that ended become the results.
+    void endFrame();
+
+    //Results of the last frames, as text for the overlay.
+    sp::string report() const;
+
+    void startTrace();
+    bool saveTrace(const sp::string& filename) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int peak_frames = 60;
+    static constexpr size_t max_trace_events = 1000000;
+
+    struct Zone {
+        const char* name;
+        int parent;
+        int depth;
+        double frame_ms = 0.0;
+        int frame_count = 0;
+        double last_ms = 0.0;
+        int last_count = 0;
+        double window_peak_ms = 0.0;
+        double peak_ms = 0.0; //highest time in a single frame over the last peak_frames frames
+    };
+    struct OpenZone {
+        int zone;
+        Clock::time_point start;
+    };
+    struct TraceEvent {
+        int zone;
+        int64_t start_us;
+        int64_t duration_us;
+    };
+
+    int findZone(const char* name, int parent);
+
+    std::vector<Zone> zones;
+    std::vector<OpenZone> stack;
+    std::vector<TraceEvent> trace;
+    bool tracing = false;
+    Clock::time_point epoch = Clock::now();
+    Clock::time_point frame_start = epoch;
+    double last_frame_ms = 0.0;
+    double window_peak_frame_ms = 0.0;
+    double peak_frame_ms = 0.0;
+    int frame_number = 0;
+};
+extern Profiler profiler;
+
+//Times the rest of the scope it is declared in, as a zone of the profiler.
+class ProfileZone
+{
+public:
+    ProfileZone(const char* name) { profiler.begin(name); }
+    ~ProfileZone() { profiler.end(); }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+};
+
+#endif//PROFILER_H
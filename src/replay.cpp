@@ -0,0 +1,151 @@
+#include "replay.h"
+
+#include <cstring>
+
+
+static constexpr char replay_magic[4] = {'O', 'D', 'R', 'P'};
+static constexpr uint32_t replay_version = 1;
+
+//Packed change byte: button index in the low 3 bits, followed by the held/down/up flags
+//and a flag to indicate the analog value is stored because it is not simply 0 or 1.
+static constexpr uint8_t change_held = 1 << 3;
+static constexpr uint8_t change_down = 1 << 4;
+static constexpr uint8_t change_up = 1 << 5;
+static constexpr uint8_t change_value = 1 << 6;
+
+void InputReplay::clear()
+{
+    changes.clear();
+    tick_count = 0;
+    recorded_frame = {};
+    playback_index = 0;
+    playback_tick = 0;
+    playback_frame = {};
+}
+
+void InputReplay::record(const Frame& frame)
+{
+    for(int n=0; n<button_count; n++) {
+        if (frame[n] != recorded_frame[n])
+            changes.push_back({tick_count, uint8_t(n), frame[n]});
+    }
+    recorded_frame = frame;
+    tick_count++;
+}
+
+void InputReplay::recordMessageDismiss()
+{
+    changes.push_back({tick_count, message_dismiss, {}});
+}
+
+const InputReplay::Frame& InputReplay::playback()
+{
+    while(playback_index < changes.size() && changes[playback_index].tick <= playback_tick) {
+        auto& change = changes[playback_index];
+        //A dismiss that was not consumed means the playback went out of sync, skip it.
+        if (change.button != message_dismiss)
+            playback_frame[change.button] = change.state;
+        playback_index++;
+    }
+    playback_tick++;
+    return playback_frame;
+}
+
+bool InputReplay::playbackMessageDismiss()
+{
+    if (playback_index < changes.size() && changes[playback_index].tick == playback_tick && changes[playback_index].button == message_dismiss) {
+        playback_index++;
+        return true;
+    }
+    return false;
+}
+
+bool InputReplay::isFinished() const
+{
+    return playback_tick >= tick_count;
+}
+
+sp::string InputReplay::save() const
+{
+    std::string result(replay_magic, sizeof(replay_magic));
+    auto write32 = [&result](uint32_t value) { result.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    write32(replay_version);
+    write32(tick_count);
+    write32(changes.size());
+    uint32_t last_tick = 0;
+    for(auto& change : changes) {
+        //Tick delta as variable length integer, most changes are only a few ticks apart.
+        uint32_t delta = change.tick - last_tick;
+        last_tick = change.tick;
+        while(delta >= 0x80) {
+            result.push_back(char((delta & 0x7f) | 0x80));
+            delta >>= 7;
+        }
+        result.push_back(char(delta));
+
+        uint8_t packed = change.button;
+        if (change.state.held) packed |= change_held;
+        if (change.state.down) packed |= change_down;
+        if (change.state.up) packed |= change_up;
+        bool store_value = change.state.value != (change.state.held ? 1.0f : 0.0f);
+        if (store_value) packed |= change_value;
+        result.push_back(char(packed));
+        if (store_value)
+            result.append(reinterpret_cast<const char*>(&change.state.value), sizeof(float));
+    }
+    return result;
+}
+
+bool InputReplay::load(const sp::string& data)
+{
+    clear();
+    size_t offset = 0;
+    auto read32 = [&](uint32_t& value) {
+        if (offset + sizeof(value) > data.size()) return false;
+        memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return true;
+    };
+    if (data.size() < sizeof(replay_magic) || memcmp(data.data(), replay_magic, sizeof(replay_magic)) != 0)
+        return false;
+    offset = sizeof(replay_magic);
+    uint32_t version, change_count;
+    if (!read32(version) || version != replay_version || !read32(tick_count) || !read32(change_count))
+        return false;
+    if (change_count > data.size())
+        return false;
+    changes.reserve(change_count);
+    uint32_t tick = 0;
+    for(uint32_t n=0; n<change_count; n++) {
+        uint32_t delta = 0;
+        for(int shift=0; ; shift+=7) {
+            if (offset >= data.size() || shift > 28)
+                return false;
+            uint8_t byte = data[offset++];
+            delta |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        tick += delta;
+        if (offset >= data.size())
+            return false;
+        uint8_t packed = data[offset++];
+        Change change;
+        change.tick = tick;
+        change.button = packed & 0x07;
+        if (change.button >= button_count && change.button != message_dismiss)
+            return false;
+        change.state.held = packed & change_held;
+        change.state.down = packed & change_down;
+        change.state.up = packed & change_up;
+        change.state.value = change.state.held ? 1.0f : 0.0f;
+        if (packed & change_value) {
+            if (offset + sizeof(float) > data.size())
+                return false;
+            memcpy(&change.state.value, data.data() + offset, sizeof(float));
+            offset += sizeof(float);
+        }
+        changes.push_back(change);
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <sp2/io/keybinding.h>
+#include <sp2/string.h>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+//State of a single input during one fixed tick.
+class InputButtonState
+{
+public:
+    float value = 0.0f;
+    bool held = false;
+    bool down = false;
+    bool up = false;
+
+    bool operator==(const InputButtonState& other) const { return value == other.value && held == other.held && down == other.down && up == other.up; }
+    bool operator!=(const InputButtonState& other) const { return !(*this == other); }
+};
+
+//Gameplay reads the keybindings through this, so the input seen by the simulation is fixed per tick,
+//and can be recorded or replaced by a recorded session.
+class InputButton
+{
+public:
+    InputButton(sp::io::Keybinding& binding) : binding(binding) {}
+
+    bool get() const { return state.held; }
+    bool getDown() const { return state.down; }
+    bool getUp() const { return state.up; }
+    float getValue() const { return state.value; }
+
+    void capture()
+    {
+        state.value = binding.getValue();
+        state.held = binding.get();
+        state.down = binding.getDown();
+        state.up = binding.getUp();
+    }
+
+    sp::io::Keybinding& binding;
+    InputButtonState state;
+};
+
+//Input of a whole session, per fixed tick. Only changes are stored, so idle ticks cost nothing.
+//Message dismissals happen while the simulation is paused, so they are stored as events at the tick they happened before.
+class InputReplay
+{
+public:
+    static constexpr int button_count = 7;
+    using Frame = std::array<InputButtonState, button_count>;
+
+    void clear();
+
+    void record(const Frame& frame);
+    void recordMessageDismiss();
+
+    const Frame& playback();
+    bool playbackMessageDismiss();
+    bool isFinished() const;
+
+    int getTickCount() const { return tick_count; }
+
+    sp::string save() const;
+    bool load(const sp::string& data);
+
+private:
+    static constexpr uint8_t message_dismiss = 7;
+
+    struct Change {
+        uint32_t tick;
+        uint8_t button;
+        InputButtonState state;
+    };
+
+    std::vector<Change> changes;
+    uint32_t tick_count = 0;
+    Frame recorded_frame{};
+
+    size_t playback_index = 0;
+    uint32_t playback_tick = 0;
+    Frame playback_frame{};
+};
+
+#endif//REPLAY_H
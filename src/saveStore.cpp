@@ -0,0 +1,348 @@
+#include "saveStore.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+static constexpr char save_magic[4] = {'O', 'D', 'S', 'V'};
+static constexpr uint32_t save_version = 1;
+
+//Ability flags of the player, stored as bits in a single byte.
+static constexpr const char* save_abilities[] = {"death_line", "can_hang", "can_teleport", "can_dive", "can_rope"};
+static constexpr const char* save_counters[] = {"death_count", "tele_count", "jump_count"};
+
+namespace {
+
+class SaveWriter
+{
+public:
+    template<typename T> void write(T value) { data.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+    void writeString(const std::string& s) { write<uint32_t>(s.size()); data += s; }
+    void writeBitset(const std::vector<int>& ids)
+    {
+        int max_id = -1;
+        for(int id : ids)
+            max_id = std::max(max_id, id);
+        std::string bits((max_id + 8) / 8, '\0');
+        for(int id : ids)
+            bits[id / 8] |= char(1 << (id % 8));
+        writeString(bits);
+    }
+
+    std::string data;
+};
+
+class SaveReader
+{
+public:
+    SaveReader(const sp::string& data) : data(data) {}
+
+    template<typename T> T read() {
+        T value{};
+        if (offset + sizeof(T) > data.size()) { error = true; return value; }
+        memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+    std::string readString() {
+        size_t size = read<uint32_t>();
+        if (size > data.size() - offset) { error = true; return {}; }
+        std::string result = data.substr(offset, size);
+        offset += size;
+        return result;
+    }
+    std::vector<int> readBitset() {
+        std::vector<int> ids;
+        auto bits = readString();
+        for(size_t n=0; n<bits.size() * 8; n++)
+            if (bits[n / 8] & (1 << (n % 8)))
+                ids.push_back(int(n));
+        return ids;
+    }
+
+    const std::string& data;
+    size_t offset = 0;
+    bool error = false;
+};
+
+//Object id from a key like "checkpoint_12", or -1 when the key does not have that form.
+//Ids are limited to what fits a reasonable bitset, larger ones end up in the json part.
+int idFromKey(const std::string& key, const char* prefix)
+{
+    size_t prefix_length = strlen(prefix);
+    if (key.size() <= prefix_length || key.compare(0, prefix_length, prefix) != 0 || key.size() - prefix_length > 5)
+        return -1;
+    int id = 0;
+    for(size_t n=prefix_length; n<key.size(); n++) {
+        if (key[n] < '0' || key[n] > '9')
+            return -1;
+        id = id * 10 + (key[n] - '0');
+    }
+    return id < 0x10000 ? id : -1;
+}
+
+}
+
+sp::string SaveStore::encode(const nlohmann::json& progress)
+{
+    std::vector<int> checkpoints;
+    std::vector<int> pickups;
+    std::vector<std::string> secrets;
+    uint8_t abilities = 0;
+    int32_t current_checkpoint = -1;
+    int32_t counters[3] = {0, 0, 0};
+    nlohmann::json extra = nlohmann::json::object();
+
+    for(auto& it : progress.items()) {
+        const auto& key = it.key();
+        const auto& value = it.value();
+        bool handled = false;
+        if (value.is_boolean()) {
+            int id;
+            if ((id = idFromKey(key, "checkpoint_")) >= 0) {
+                if (value) checkpoints.push_back(id);
+                handled = true;
+            } else if ((id = idFromKey(key, "pickup_")) >= 0) {
+                if (value) pickups.push_back(id);
+                handled = true;
+            } else if (key.compare(0, 7, "secret_") == 0 && key.size() > 7 && key.size() < 0x10000) {
+                if (value) secrets.push_back(key.substr(7));
+                handled = true;
+            }
+            for(int n=0; n<5; n++) {
+                if (key == save_abilities[n]) {
+                    if (value) abilities |= 1 << n;
+                    handled = true;
+                }
+            }
+        } else if (value.is_number_integer()) {
+            if (key == "current_checkpoint" && value >= 0 && value <= INT32_MAX) {
+                current_checkpoint = value;
+                handled = true;
+            }
+            for(int n=0; n<3; n++) {
+                if (key == save_counters[n] && value >= 0 && value <= INT32_MAX) {
+                    counters[n] = value;
+                    handled = true;
+                }
+            }
+        }
+        if (!handled)
+            extra[key] = value;
+    }
+
+    SaveWriter writer;
+    writer.data.append(save_magic, sizeof(save_magic));
+    writer.write<uint32_t>(save_version);
+    writer.write<uint8_t>(abilities);
+    writer.write<int32_t>(current_checkpoint);
+    for(auto counter : counters)
+        writer.write<int32_t>(counter);
+    writer.writeBitset(checkpoints);
+    writer.writeBitset(pickups);
+    writer.write<uint32_t>(secrets.size());
+    for(auto& secret : secrets)
+        writer.writeString(secret);
+    writer.writeString(extra.empty() ? std::string() : extra.dump());
+    return writer.data;
+}
+
+bool SaveStore::decode(const sp::string& data, nlohmann::json& progress)
+{
+    if (data.size() < sizeof(save_magic) || memcmp(data.data(), save_magic, sizeof(save_magic)) != 0) {
+        //Saves from before the binary format are plain json.
+        auto json = nlohmann::json::parse(data, nullptr, false, false);
+        if (json.is_discarded() || !json.is_object())
+            return false;
+        progress = json;
+        return true;
+    }
+
+    SaveReader reader(data);
+    reader.offset = sizeof(save_magic);
+    if (reader.read<uint32_t>() != save_version)
+        return false;
+    nlohmann::json result = nlohmann::json::object();
+    auto abilities = reader.read<uint8_t>();
+    for(int n=0; n<5; n++)
+        if (abilities & (1 << n))
+            result[save_abilities[n]] = true;
+    auto current_checkpoint = reader.read<int32_t>();
+    if (current_checkpoint >= 0)
+        result["current_checkpoint"] = current_checkpoint;
+    for(int n=0; n<3; n++)
+        result[save_counters[n]] = reader.read<int32_t>();
+    for(int id : reader.readBitset())
+        result["checkpoint_" + std::to_string(id)] = true;
+    for(int id : reader.readBitset())
+        result["pickup_" + std::to_string(id)] = true;
+    size_t secret_count = reader.read<uint32_t>();
+    for(size_t n=0; n<secret_count && !reader.error; n++)
+        result["secret_" + reader.readString()] = true;
+    auto extra_data = reader.readString();
+    if (reader.error)
+        return false;
+    if (!extra_data.empty()) {
+        auto extra = nlohmann::json::parse(extra_data, nullptr, false, false);
+        if (extra.is_discarded() || !extra.is_object())
+            return false;
+        for(auto& it : extra.items())
+            result[it.key()] = it.value();
+    }
+    progress = std::move(result);
+    return true;
+}
+
+bool SaveStore::convertFile(const sp::string& input_filename, const sp::string& output_filename)
+{
+    nlohmann::json progress;
+    if (!decode(sp::io::loadFileContents(input_filename), progress)) {
+        LOG(Error, "Failed to read save", input_filename);
+        return false;
+    }
+    bool to_json = output_filename.size() >= 5 && output_filename.compare(output_filename.size() - 5, 5, ".json") == 0;
+    auto data = to_json ? sp::string(progress.dump(2)) : encode(progress);
+    if (!sp::io::saveFileContents(output_filename, data)) {
+        LOG(Error, "Failed to write save", output_filename);
+        return false;
+    }
+    LOG(Info, "Converted", input_filename, "into", output_filename, data.size(), "bytes");
+    return true;
+}
+
+SaveStore::~SaveStore()
+{
+    close();
+}
+
+void SaveStore::open(const sp::string& filename)
+{
+    close();
+    this->filename = filename;
+    progress = nlohmann::json::object();
+    has_progress = decode(sp::io::loadFileContents(filename), progress);
+#ifndef EMSCRIPTEN
+    stop = false;
+    writer = std::thread(&SaveStore::writerMain, this);
+#endif
+}
+
+void SaveStore::close()
+{
+#ifndef EMSCRIPTEN
+    if (!writer.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wakeup.notify_one();
+    writer.join();
+#endif
+}
+
+void SaveStore::update(const nlohmann::json& entries)
+{
+    bool dirty = !has_progress;
+    for(auto& it : entries.items()) {
+        auto current = progress.find(it.key());
+        if (current != progress.end() && *current == it.value())
+            continue;
+        progress[it.key()] = it.value();
+        dirty = true;
+    }
+    has_progress = true;
+    if (dirty)
+        queueWrite(encode(progress));
+}
+
+void SaveStore::clear()
+{
+    progress = nlohmann::json::object();
+    has_progress = false;
+    queueWrite("");
+}
+
+void SaveStore::queueWrite(sp::string data)
+{
+    if (filename.empty())
+        return;
+#ifdef EMSCRIPTEN
+    writeFile(data);
+#else
+    {
+        //Only the latest state matters, so a write that did not start yet is simply replaced.
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_data = std::move(data);
+        has_pending = true;
+    }
+    wakeup.notify_one();
+#endif
+}
+
+//Write the file and wait till it is on the storage itself, not just in the cache of the OS.
+static bool writeFileSynced(const sp::string& filename, const sp::string& data)
+{
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size() && fflush(f) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(f)) == 0;
+#else
+    ok = ok && fsync(fileno(f)) == 0;
+#endif
+    return fclose(f) == 0 && ok;
+}
+
+void SaveStore::writeFile(const sp::string& data)
+{
+    //The data has to be on the storage before the rename, else a power loss can leave the renamed file empty.
+    auto temp_filename = filename + ".tmp";
+    if (!writeFileSynced(temp_filename, data)) {
+        LOG(Error, "Failed to write", temp_filename);
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_filename.c_str(), filename.c_str(), ec);
+    if (ec) {
+        LOG(Error, "Failed to replace", filename, ec.message());
+        return;
+    }
+#ifndef _WIN32
+    //The rename itself is only durable once the directory is synced.
+    auto directory = std::filesystem::path(filename.c_str()).parent_path();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+
+#ifndef EMSCRIPTEN
+void SaveStore::writerMain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        wakeup.wait(lock, [this]() { return has_pending || stop; });
+        if (!has_pending)
+            break;
+        sp::string data = std::move(pending_data);
+        has_pending = false;
+        lock.unlock();
+        writeFile(data);
+        lock.lock();
+    }
+}
+#endif
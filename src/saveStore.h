@@ -0,0 +1,63 @@
+#ifndef SAVE_STORE_H
+#define SAVE_STORE_H
+
+#include <sp2/string.h>
+#include <nlohmann/json.hpp>
+#ifndef EMSCRIPTEN
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+
+//The saved progress of the game. It is kept in memory, and changes are written to disk from a background thread,
+//so saving at a checkpoint never waits on slow storage. Every write goes to a temporary file first, which is then
+//synced to the storage and renamed over the old save, so a crash or power loss halfway a write never leaves a broken save behind.
+//On disk the progress is stored in a compact binary format, older json saves are still read and converted on the next write.
+class SaveStore
+{
+public:
+    //Binary form of the progress. Checkpoints and pickups become bitsets by object id, counters and abilities fixed fields.
+    //Entries that do not fit these are kept as json, so nothing is lost.
+    static sp::string encode(const nlohmann::json& progress);
+    //Accepts both the binary form and a json save. Returns false if the data is neither.
+    static bool decode(const sp::string& data, nlohmann::json& progress);
+    //Convert a save file, to binary, or to json when the output filename ends in .json.
+    static bool convertFile(const sp::string& input_filename, const sp::string& output_filename);
+
+    ~SaveStore();
+
+    //Read the progress from filename, changes are written back to the same file.
+    void open(const sp::string& filename);
+    //Wait till all changes are written and stop the writer thread.
+    void close();
+
+    bool hasProgress() const { return has_progress; }
+    const nlohmann::json& getProgress() const { return progress; }
+
+    //Merge entries into the progress. Only when an entry changed the save is written.
+    void update(const nlohmann::json& entries);
+    //Forget all progress, for starting a new game.
+    void clear();
+
+private:
+    void queueWrite(sp::string data);
+    void writeFile(const sp::string& data);
+
+    sp::string filename;
+    nlohmann::json progress = nlohmann::json::object();
+    bool has_progress = false;
+
+#ifndef EMSCRIPTEN
+    void writerMain();
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    sp::string pending_data;
+    bool has_pending = false;
+    bool stop = false;
+#endif
+};
+
+#endif//SAVE_STORE_H
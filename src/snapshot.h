@@ -0,0 +1,99 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+
+//Flat copy of the dynamic state of a world, made by World::snapshot and applied again by World::restore.
+//Nodes store their state as an entry under a key that identifies them in the level, like their object id,
+//so a snapshot can be restored onto nodes that were streamed out and in again since it was made.
+class WorldSnapshot
+{
+public:
+    bool empty() const { return data.empty(); }
+    size_t size() const { return data.size(); }
+
+    std::string data;
+};
+
+class SnapshotWriter
+{
+public:
+    SnapshotWriter(WorldSnapshot& snapshot) : data(snapshot.data) { data.clear(); }
+
+    template<typename T> void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be stored in a snapshot");
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void writeString(const std::string& s) { write<uint32_t>(s.size()); data += s; }
+
+    void beginEntry(uint32_t key)
+    {
+        write(key);
+        entry_start = data.size();
+        write<uint32_t>(0);
+    }
+    void endEntry()
+    {
+        uint32_t size = data.size() - entry_start - sizeof(uint32_t);
+        memcpy(&data[entry_start], &size, sizeof(size));
+    }
+
+private:
+    std::string& data;
+    size_t entry_start = 0;
+};
+
+class SnapshotReader
+{
+public:
+    SnapshotReader(const WorldSnapshot& snapshot) : data(snapshot.data) {}
+
+    template<typename T> T read()
+    {
+        T value{};
+        if (offset + sizeof(T) > entry_end) { error = true; return value; }
+        memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+    std::string readString()
+    {
+        size_t size = read<uint32_t>();
+        if (size > entry_end - offset) { error = true; return {}; }
+        std::string result = data.substr(offset, size);
+        offset += size;
+        return result;
+    }
+
+    //Move to the next entry, whatever part of the current entry was not read is skipped.
+    bool nextEntry(uint32_t& key)
+    {
+        if (in_entry)
+            offset = entry_end;
+        in_entry = true;
+        if (offset >= data.size())
+            return false;
+        entry_end = data.size();
+        key = read<uint32_t>();
+        uint32_t size = read<uint32_t>();
+        if (error || size > data.size() - offset)
+            return false;
+        entry_end = offset + size;
+        return true;
+    }
+
+    bool error = false;
+
+private:
+    const std::string& data;
+    size_t offset = 0;
+    size_t entry_end = data.size();
+    bool in_entry = false;
+};
+
+#endif//SNAPSHOT_H
@@ -0,0 +1,76 @@
+#ifndef SOLID_REGIONS_H
+#define SOLID_REGIONS_H
+
+#include <sp2/math/rect.h>
+#include <unordered_map>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+
+
+//A connected region of solid tiles, covered by rectangles. Every column of the region is split into its vertical runs
+//of tiles, and neighbouring columns with the same run are joined. The sides of a rectangle are then always a full run,
+//so no corner of a rectangle lies halfway a wall, and something falling along a wall has no seam to catch on.
+//Floors and ceilings do get seams between the rectangles.
+struct SolidRegion
+{
+    std::vector<sp::Rect2i> areas;
+    std::vector<sp::Vector2i> tiles;
+};
+
+//Regions of tiles connected through their sides.
+inline std::vector<SolidRegion> buildSolidRegions(const std::vector<sp::Vector2i>& tiles)
+{
+    auto key = [](sp::Vector2i p) { return (uint64_t(uint32_t(p.x)) << 32) | uint64_t(uint32_t(p.y)); };
+    std::unordered_map<uint64_t, int> region_of; //-1 until the tile is assigned a region
+    for(auto tile : tiles)
+        region_of[key(tile)] = -1;
+    static const sp::Vector2i sides[4] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}};
+
+    std::vector<SolidRegion> regions;
+    for(auto start : tiles) {
+        if (region_of[key(start)] != -1)
+            continue;
+        int index = int(regions.size());
+        regions.emplace_back();
+        auto& region = regions.back();
+        region_of[key(start)] = index;
+        region.tiles.push_back(start);
+        for(size_t n=0; n<region.tiles.size(); n++) {
+            for(auto side : sides) {
+                auto p = region.tiles[n] + side;
+                auto it = region_of.find(key(p));
+                if (it != region_of.end() && it->second == -1) {
+                    it->second = index;
+                    region.tiles.push_back(p);
+                }
+            }
+        }
+
+        //Runs by their y and height, each with the columns they are in, in order.
+        auto sorted = region.tiles;
+        std::sort(sorted.begin(), sorted.end(), [](sp::Vector2i a, sp::Vector2i b) { return a.x != b.x ? a.x < b.x : a.y < b.y; });
+        std::map<std::pair<int, int>, std::vector<int>> runs;
+        for(size_t n=0; n<sorted.size(); ) {
+            size_t end = n + 1;
+            while(end < sorted.size() && sorted[end].x == sorted[n].x && sorted[end].y == sorted[end - 1].y + 1)
+                end++;
+            runs[{sorted[n].y, int(end - n)}].push_back(sorted[n].x);
+            n = end;
+        }
+        for(auto& it : runs) {
+            auto& columns = it.second;
+            for(size_t n=0; n<columns.size(); ) {
+                size_t end = n + 1;
+                while(end < columns.size() && columns[end] == columns[end - 1] + 1)
+                    end++;
+                region.areas.push_back({{columns[n], it.first.first}, {int(end - n), it.first.second}});
+                n = end;
+            }
+        }
+    }
+    return regions;
+}
+
+#endif//SOLID_REGIONS_H
@@ -0,0 +1,249 @@
+#include "spriteAtlas.h"
+#include "spriteBatch.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/resourceProvider.h>
+#include <sp2/io/directoryResourceProvider.h>
+#include <sp2/io/filesystem.h>
+#include <sp2/graphics/textureManager.h>
+#include <sp2/graphics/image/image.h>
+#include <sp2/stringutil/convert.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <sstream>
+
+
+//Empty border around each image, filled with its edge pixels, so sampling at the edge of a sprite never picks up its neighbour.
+static constexpr int atlas_padding = 1;
+static constexpr int atlas_max_size = 4096;
+
+void SpriteAtlas::load(const sp::string& manifest_resource)
+{
+    auto stream = sp::io::ResourceProvider::get(manifest_resource);
+    if (!stream)
+        return;
+    auto json = nlohmann::json::parse(stream->readAll(), nullptr, false);
+    if (json.is_discarded() || !json.is_object()) {
+        LOG(Error, "Invalid sprite atlas manifest", manifest_resource);
+        return;
+    }
+    texture_name = json.value("texture", "");
+    texture_size = sp::Vector2f(json["size"][0], json["size"][1]);
+    for(auto& it : json["sprites"].items()) {
+        auto& r = it.value();
+        sprites[it.key()] = sp::Rect2f(sp::Vector2f(float(r[0]) / texture_size.x, float(r[1]) / texture_size.y), sp::Vector2f(float(r[2]) / texture_size.x, float(r[3]) / texture_size.y));
+    }
+    for(auto& it : json["animations"].items())
+        animations[it.key()] = it.value().get<std::string>();
+    LOG(Info, "Loaded sprite atlas with", sprites.size(), "images");
+}
+
+sp::Texture* SpriteAtlas::getTexture(const sp::string& image) const
+{
+    if (sprites.find(image) != sprites.end())
+        return sp::texture_manager.get(texture_name);
+    return sp::texture_manager.get(image);
+}
+
+sp::Rect2f SpriteAtlas::getUVRect(const sp::string& image) const
+{
+    auto it = sprites.find(image);
+    if (it != sprites.end())
+        return it->second;
+    return sp::Rect2f(sp::Vector2f(0, 0), sp::Vector2f(1, 1));
+}
+
+std::shared_ptr<sp::MeshData> SpriteAtlas::getQuad(const sp::string& image, sp::Vector2f size) const
+{
+    auto uv = getUVRect(image);
+    return getQuadMesh(size, sp::Vector2f(uv.position.x, uv.position.y + uv.size.y), sp::Vector2f(uv.position.x + uv.size.x, uv.position.y));
+}
+
+std::unique_ptr<sp::SpriteAnimation> SpriteAtlas::loadAnimation(const sp::string& resource) const
+{
+    auto it = animations.find(resource);
+    if (it != animations.end())
+        return sp::SpriteAnimation::load(it->second);
+    return sp::SpriteAnimation::load(resource);
+}
+
+namespace {
+
+struct PackEntry {
+    sp::string name;
+    sp::Image image;
+    sp::Vector2i position;
+};
+
+//Shelf packing, images are placed in rows from the highest to the lowest. Returns the used height.
+int packShelves(std::vector<PackEntry*>& entries, int width)
+{
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+    for(auto entry : entries) {
+        auto size = entry->image.getSize() + sp::Vector2i(atlas_padding * 2, atlas_padding * 2);
+        if (size.x > width)
+            return atlas_max_size + 1;
+        if (x + size.x > width) {
+            x = 0;
+            y += row_height;
+            row_height = 0;
+        }
+        entry->position = sp::Vector2i(x + atlas_padding, y + atlas_padding);
+        x += size.x;
+        row_height = std::max(row_height, size.y);
+    }
+    return y + row_height;
+}
+
+//Sprite animation file with its frame positions moved to where its texture ended up in the atlas.
+sp::string relocateAnimation(const sp::string& source, const sp::string& texture_name, sp::Vector2i texture_size, sp::Vector2i offset)
+{
+    std::istringstream input(source);
+    std::ostringstream output;
+    std::string line;
+    while(std::getline(input, line)) {
+        auto start = line.find_first_not_of(" \t");
+        auto indent = line.substr(0, start == std::string::npos ? line.size() : start);
+        auto key_end = line.find(':');
+        auto key = (start == std::string::npos || key_end == std::string::npos) ? std::string() : line.substr(start, key_end - start);
+        if (key == "texture") {
+            output << indent << "texture: " << texture_name << "\n";
+        } else if (key == "texture_size") {
+            output << indent << "texture_size: " << texture_size.x << ", " << texture_size.y << "\n";
+        } else if (key == "position") {
+            auto value = line.substr(key_end + 1);
+            auto comma = value.find(',');
+            int x = sp::stringutil::convert::toInt(value.substr(0, comma));
+            int y = comma == std::string::npos ? 0 : sp::stringutil::convert::toInt(value.substr(comma + 1));
+            output << indent << "position: " << (x + offset.x) << ", " << (y + offset.y) << "\n";
+        } else {
+            output << line << "\n";
+        }
+    }
+    return output.str();
+}
+
+sp::string animationTexture(const sp::string& source)
+{
+    std::istringstream input(source);
+    std::string line;
+    while(std::getline(input, line)) {
+        auto start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "texture:") == 0) {
+            auto value = line.substr(start + 8);
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            return value;
+        }
+    }
+    return "";
+}
+
+}
+
+bool SpriteAtlas::pack(const sp::string& resource_directory, const sp::string& output_directory, const sp::string& name, const std::vector<sp::string>& files)
+{
+    new sp::io::DirectoryResourceProvider(resource_directory);
+
+    std::vector<std::pair<sp::string, sp::string>> animation_files;
+    std::vector<sp::string> image_names;
+    for(auto& file : files) {
+        if (file.endswith(".txt")) {
+            auto stream = sp::io::ResourceProvider::get(file);
+            if (!stream) {
+                LOG(Error, "Failed to open", file);
+                return false;
+            }
+            auto source = stream->readAll();
+            auto texture = animationTexture(source);
+            if (texture.empty()) {
+                LOG(Error, "No texture in", file);
+                return false;
+            }
+            animation_files.push_back({file, source});
+            image_names.push_back(texture);
+        } else {
+            image_names.push_back(file);
+        }
+    }
+    std::sort(image_names.begin(), image_names.end());
+    image_names.erase(std::unique(image_names.begin(), image_names.end()), image_names.end());
+
+    std::vector<PackEntry> entries(image_names.size());
+    std::vector<PackEntry*> order;
+    for(size_t n=0; n<image_names.size(); n++) {
+        entries[n].name = image_names[n];
+        if (!entries[n].image.loadFromStream(sp::io::ResourceProvider::get(image_names[n]))) {
+            LOG(Error, "Failed to load", image_names[n]);
+            return false;
+        }
+        order.push_back(&entries[n]);
+    }
+    std::sort(order.begin(), order.end(), [](const PackEntry* a, const PackEntry* b) {
+        if (a->image.getSize().y != b->image.getSize().y)
+            return a->image.getSize().y > b->image.getSize().y;
+        return a->name < b->name;
+    });
+
+    //Smallest power of two width where everything fits in a texture that is not higher than it is wide.
+    int width = 16;
+    int height = 0;
+    while(width <= atlas_max_size) {
+        height = packShelves(order, width);
+        if (height <= width)
+            break;
+        width *= 2;
+    }
+    if (width > atlas_max_size) {
+        LOG(Error, "Images do not fit in a", atlas_max_size, "atlas");
+        return false;
+    }
+    int texture_height = 1;
+    while(texture_height < height)
+        texture_height *= 2;
+    sp::Vector2i atlas_size{width, texture_height};
+
+    sp::Image atlas(atlas_size, 0);
+    auto atlas_pixels = atlas.getPtr();
+    nlohmann::json manifest;
+    manifest["texture"] = name + ".png";
+    manifest["size"] = {atlas_size.x, atlas_size.y};
+    manifest["sprites"] = nlohmann::json::object();
+    manifest["animations"] = nlohmann::json::object();
+    for(auto& entry : entries) {
+        auto size = entry.image.getSize();
+        auto pixels = entry.image.getPtr();
+        for(int y=-atlas_padding; y<size.y+atlas_padding; y++) {
+            for(int x=-atlas_padding; x<size.x+atlas_padding; x++) {
+                int sx = std::clamp(x, 0, size.x - 1);
+                int sy = std::clamp(y, 0, size.y - 1);
+                atlas_pixels[(entry.position.x + x) + (entry.position.y + y) * atlas_size.x] = pixels[sx + sy * size.x];
+            }
+        }
+        manifest["sprites"][entry.name] = {entry.position.x, entry.position.y, size.x, size.y};
+    }
+
+    for(auto& it : animation_files) {
+        auto texture = animationTexture(it.second);
+        auto entry = std::find_if(entries.begin(), entries.end(), [&texture](const PackEntry& e) { return e.name == texture; });
+        auto packed_name = name + "." + it.first;
+        if (!sp::io::saveFileContents(output_directory + "/" + packed_name, relocateAnimation(it.second, name + ".png", atlas_size, entry->position))) {
+            LOG(Error, "Failed to write", packed_name);
+            return false;
+        }
+        manifest["animations"][it.first] = packed_name;
+    }
+
+    if (!atlas.saveToFile(output_directory + "/" + name + ".png")) {
+        LOG(Error, "Failed to write", name + ".png");
+        return false;
+    }
+    if (!sp::io::saveFileContents(output_directory + "/" + name + ".json", manifest.dump(1))) {
+        LOG(Error, "Failed to write", name + ".json");
+        return false;
+    }
+    LOG(Info, "Packed", entries.size(), "images into a", atlas_size.x, "x", atlas_size.y, "atlas");
+    return true;
+}
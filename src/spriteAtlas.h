@@ -0,0 +1,42 @@
+#ifndef SPRITE_ATLAS_H
+#define SPRITE_ATLAS_H
+
+#include <sp2/string.h>
+#include <sp2/math/rect.h>
+#include <sp2/graphics/texture.h>
+#include <sp2/graphics/meshdata.h>
+#include <sp2/graphics/spriteAnimation.h>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+
+
+//Images of sprites packed together in a single texture, so nodes showing different sprites still share their texture.
+//The atlas is made by a build step, described by a manifest. Without the manifest every image is used as its own texture,
+//so the game also runs from the plain resources.
+class SpriteAtlas
+{
+public:
+    //Load the manifest written by pack(), does nothing when the resource does not exist.
+    void load(const sp::string& manifest_resource);
+
+    sp::Texture* getTexture(const sp::string& image) const;
+    //Area of the texture that holds the image, in texture coordinates.
+    sp::Rect2f getUVRect(const sp::string& image) const;
+    //Shared quad of the given size that shows the full image.
+    std::shared_ptr<sp::MeshData> getQuad(const sp::string& image, sp::Vector2f size) const;
+    //Sprite animation from a resource, the packed version when the atlas has one.
+    std::unique_ptr<sp::SpriteAnimation> loadAnimation(const sp::string& resource) const;
+
+    //Build step, packs the images and the textures of the sprite animation files from resource_directory into name.png,
+    //and writes it with the manifest name.json and packed versions of the animation files into output_directory.
+    static bool pack(const sp::string& resource_directory, const sp::string& output_directory, const sp::string& name, const std::vector<sp::string>& files);
+
+private:
+    sp::string texture_name;
+    sp::Vector2f texture_size;
+    std::unordered_map<sp::string, sp::Rect2f> sprites;
+    std::unordered_map<sp::string, sp::string> animations;
+};
+
+#endif//SPRITE_ATLAS_H
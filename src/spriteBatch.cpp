@@ -0,0 +1,154 @@
+#include "spriteBatch.h"
+
+#include <sp2/scene/node.h>
+#include <sp2/scene/scene.h>
+#include <unordered_map>
+#include <algorithm>
+
+
+//Indices are 16 bit, so a single batch can hold this many quads.
+static constexpr size_t max_batch_quads = 0x10000 / 4;
+
+namespace {
+
+struct QuadShape {
+    sp::Vector2f size;
+    sp::Vector2f uv0;
+    sp::Vector2f uv1;
+
+    bool operator==(const QuadShape& other) const
+    {
+        return size.x == other.size.x && size.y == other.size.y && uv0.x == other.uv0.x && uv0.y == other.uv0.y && uv1.x == other.uv1.x && uv1.y == other.uv1.y;
+    }
+};
+
+struct QuadShapeHash {
+    size_t operator()(const QuadShape& shape) const
+    {
+        size_t result = 0;
+        for(float f : {shape.size.x, shape.size.y, shape.uv0.x, shape.uv0.y, shape.uv1.x, shape.uv1.y})
+            result = result * 31 + std::hash<float>()(f);
+        return result;
+    }
+};
+
+//Quad meshes are never changed after creation, so every node showing the same quad shares one mesh.
+//They are kept for the whole run, the number of different quads is small.
+std::unordered_map<QuadShape, std::shared_ptr<sp::MeshData>, QuadShapeHash> quad_cache;
+std::unordered_map<const sp::MeshData*, QuadShape> quad_shapes;
+
+const QuadShape* findQuadShape(const std::shared_ptr<sp::MeshData>& mesh)
+{
+    auto it = quad_shapes.find(mesh.get());
+    if (it == quad_shapes.end())
+        return nullptr;
+    return &it->second;
+}
+
+bool sameBatch(const sp::RenderData& a, const sp::RenderData& b)
+{
+    return a.shader == b.shader && a.texture == b.texture && a.type == b.type && a.order == b.order
+        && a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b && a.color.a == b.color.a;
+}
+
+}
+
+std::shared_ptr<sp::MeshData> getQuadMesh(sp::Vector2f size, sp::Vector2f uv0, sp::Vector2f uv1)
+{
+    QuadShape shape{size, uv0, uv1};
+    auto& mesh = quad_cache[shape];
+    if (!mesh) {
+        mesh = sp::MeshData::createQuad(size, uv0, uv1);
+        quad_shapes[mesh.get()] = shape;
+    }
+    return mesh;
+}
+
+
+void SpriteBatchRenderPass::render(sp::RenderQueue& queue)
+{
+    for(auto& batch : batches) {
+        batch.vertices.clear();
+        batch.indices.clear();
+        batch.used = false;
+    }
+    current_camera = nullptr;
+    sp::BasicNodeRenderPass::render(queue);
+    flushBatches(queue, current_camera);
+    current_camera = nullptr;
+
+    //Drop batches that were not used this frame, like the ones of a color that faded out.
+    batches.erase(std::remove_if(batches.begin(), batches.end(), [](const Batch& batch) { return !batch.used; }), batches.end());
+}
+
+//Batches are only known to be complete once the nodes of the next scene come in, at that point the queue is
+//already set to the camera of that scene, so switch back to add the batches with the camera they belong to.
+void SpriteBatchRenderPass::flushBatches(sp::RenderQueue& queue, sp::P<sp::Camera> camera)
+{
+    if (!camera)
+        return;
+    queue.setCamera(camera);
+    for(auto& batch : batches) {
+        if (!batch.used || batch.camera != camera)
+            continue;
+        if (!batch.render_data.mesh)
+            batch.render_data.mesh = sp::MeshData::create(std::move(batch.vertices), std::move(batch.indices), sp::MeshData::Type::Dynamic);
+        else
+            batch.render_data.mesh->update(std::move(batch.vertices), std::move(batch.indices));
+        queue.add(sp::Matrix4x4f::identity(), batch.render_data);
+    }
+}
+
+void SpriteBatchRenderPass::addNodeToRenderQueue(sp::RenderQueue& queue, sp::P<sp::Node>& node)
+{
+    //The base pass renders the scenes one after the other, each with its own camera.
+    sp::P<sp::Camera> camera = node->getScene()->getCamera();
+    if (camera != current_camera) {
+        flushBatches(queue, current_camera);
+        current_camera = camera;
+        queue.setCamera(camera);
+    }
+
+    auto& render_data = node->render_data;
+    const QuadShape* shape = nullptr;
+    if (render_data.type != sp::RenderData::Type::None && render_data.mesh)
+        shape = findQuadShape(render_data.mesh);
+    if (!shape) {
+        sp::BasicNodeRenderPass::addNodeToRenderQueue(queue, node);
+        return;
+    }
+
+    auto& batch = getBatch(camera, render_data);
+    auto position = node->getGlobalPosition2D();
+    auto rotation = node->getGlobalRotation2D();
+    auto half_size = sp::Vector2d(shape->size.x * render_data.scale.x, shape->size.y * render_data.scale.y) * 0.5;
+    auto corner = [&](double x, double y, float u, float v) {
+        auto p = position + sp::Vector2d(x * half_size.x, y * half_size.y).rotate(rotation);
+        batch.vertices.emplace_back(sp::Vector3f(float(p.x), float(p.y), 0.0f), sp::Vector3f(0.0f, 0.0f, 1.0f), sp::Vector2f(u, v));
+    };
+    uint16_t index = uint16_t(batch.vertices.size());
+    corner(-1, -1, shape->uv0.x, shape->uv0.y);
+    corner(1, -1, shape->uv1.x, shape->uv0.y);
+    corner(-1, 1, shape->uv0.x, shape->uv1.y);
+    corner(1, 1, shape->uv1.x, shape->uv1.y);
+    for(int n : {0, 1, 2, 2, 1, 3})
+        batch.indices.push_back(index + n);
+}
+
+SpriteBatchRenderPass::Batch& SpriteBatchRenderPass::getBatch(sp::P<sp::Camera> camera, const sp::RenderData& render_data)
+{
+    for(auto& batch : batches) {
+        if (batch.camera == camera && sameBatch(batch.render_data, render_data) && batch.vertices.size() / 4 < max_batch_quads) {
+            batch.used = true;
+            return batch;
+        }
+    }
+    batches.emplace_back();
+    auto& batch = batches.back();
+    batch.camera = camera;
+    batch.render_data = render_data;
+    batch.render_data.mesh = nullptr;
+    batch.render_data.scale = sp::Vector3f(1, 1, 1);
+    batch.used = true;
+    return batch;
+}
@@ -0,0 +1,43 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <sp2/graphics/meshdata.h>
+#include <sp2/graphics/scene/basicnoderenderpass.h>
+#include <sp2/scene/camera.h>
+#include <memory>
+#include <vector>
+
+
+//Shared quad mesh of the given size and texture area, made once and reused by all nodes that ask for the same quad.
+//The SpriteBatchRenderPass knows the shape of these, so nodes using them are drawn together with other quads.
+std::shared_ptr<sp::MeshData> getQuadMesh(sp::Vector2f size, sp::Vector2f uv0=sp::Vector2f(0, 1), sp::Vector2f uv1=sp::Vector2f(1, 0));
+
+//Replacement of the BasicNodeRenderPass. Nodes showing a quad from getQuadMesh are not drawn one by one,
+//quads that share camera, shader, texture, color and order are collected into a single dynamic mesh every frame.
+//The batches of a scene are added to the queue right after the nodes of that scene, with the camera of that scene.
+//All other nodes are drawn as usual.
+class SpriteBatchRenderPass : public sp::BasicNodeRenderPass
+{
+public:
+    virtual void render(sp::RenderQueue& queue) override;
+
+protected:
+    virtual void addNodeToRenderQueue(sp::RenderQueue& queue, sp::P<sp::Node>& node) override;
+
+private:
+    struct Batch {
+        sp::P<sp::Camera> camera;
+        sp::RenderData render_data;
+        sp::MeshData::Vertices vertices;
+        sp::MeshData::Indices indices;
+        bool used = false;
+    };
+
+    Batch& getBatch(sp::P<sp::Camera> camera, const sp::RenderData& render_data);
+    void flushBatches(sp::RenderQueue& queue, sp::P<sp::Camera> camera);
+
+    std::vector<Batch> batches;
+    sp::P<sp::Camera> current_camera; //camera of the scene whose nodes are being added
+};
+
+#endif//SPRITE_BATCH_H
@@ -0,0 +1,112 @@
+#ifndef TICK_SCHEDULER_H
+#define TICK_SCHEDULER_H
+
+#include <sp2/scene/node.h>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+
+//Receives the updates of a TickScheduler while it is awake.
+class TickListener
+{
+public:
+    virtual ~TickListener() {}
+
+    virtual void onScheduledUpdate(float delta) {}
+    virtual void onScheduledFixedUpdate() {}
+
+private:
+    bool awake[2] = {false, false};
+    bool listed[2] = {false, false};
+
+    friend class TickScheduler;
+};
+
+//Updates for nodes that are idle most of the time. Instead of overriding onUpdate or onFixedUpdate, which run for
+//every node, these nodes wake up in the scheduler when something happens to them, like a collision or a state change,
+//and go back to sleep when they are done. Only awake nodes are visited, so the cost follows the number of active nodes.
+class TickScheduler
+{
+public:
+    enum Phase {
+        Update = 0,
+        FixedUpdate = 1,
+    };
+
+    struct Stats {
+        int visited = 0; //in the last run
+        int64_t total_visited = 0;
+        int64_t runs = 0;
+    };
+
+    template<typename T> void wake(T* node, Phase phase)
+    {
+        TickListener* listener = node;
+        listener->awake[phase] = true;
+        if (!listener->listed[phase]) {
+            listener->listed[phase] = true;
+            lists[phase].push_back({node, listener});
+        }
+    }
+
+    //The node stays in the list till the end of the current run, so sleeping is allowed from inside an update.
+    void sleep(TickListener* listener, Phase phase)
+    {
+        listener->awake[phase] = false;
+    }
+
+    bool isAwake(const TickListener* listener, Phase phase) const
+    {
+        return listener->awake[phase];
+    }
+
+    void update(float delta)
+    {
+        run(Update, [delta](TickListener* listener) { listener->onScheduledUpdate(delta); });
+    }
+
+    void fixedUpdate()
+    {
+        run(FixedUpdate, [](TickListener* listener) { listener->onScheduledFixedUpdate(); });
+    }
+
+    const Stats& getStats(Phase phase) const { return stats[phase]; }
+
+private:
+    struct Entry {
+        sp::P<sp::Node> node;
+        TickListener* listener;
+    };
+
+    template<typename F> void run(Phase phase, F f)
+    {
+        auto& list = lists[phase];
+        auto& stat = stats[phase];
+        stat.visited = 0;
+        //Nodes woken during the run are added to the end, and still get their update.
+        for(size_t n=0; n<list.size(); n++) {
+            Entry entry = list[n];
+            if (!entry.node || !entry.listener->awake[phase])
+                continue;
+            stat.visited++;
+            f(entry.listener);
+        }
+        stat.total_visited += stat.visited;
+        stat.runs++;
+
+        list.erase(std::remove_if(list.begin(), list.end(), [phase](const Entry& entry) {
+            if (!entry.node)
+                return true;
+            if (entry.listener->awake[phase])
+                return false;
+            entry.listener->listed[phase] = false;
+            return true;
+        }), list.end());
+    }
+
+    std::vector<Entry> lists[2];
+    Stats stats[2];
+};
+
+#endif//TICK_SCHEDULER_H
@@ -0,0 +1,95 @@
+#ifndef TILE_FLAGS_H
+#define TILE_FLAGS_H
+
+#include <sp2/math/vector.h>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+
+
+//Gameplay properties of tiles, packed as bits in a single byte per tile.
+//Tiles are stored in 16x16 chunks, found through a dense directory that covers the bounds of the level.
+//Chunks without any flags all share the empty chunk, so a lookup is a bounds check and two array reads.
+class TileFlagGrid
+{
+public:
+    enum Flag : uint8_t {
+        Water = 1 << 0,
+        Moss = 1 << 1,
+        Spike = 1 << 2,
+        Solid = 1 << 3,
+    };
+
+    TileFlagGrid()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        chunks.assign(1, {}); //chunk 0 is the shared empty chunk
+        directory.clear();
+        directory_min = {0, 0};
+        directory_size = {0, 0};
+    }
+
+    uint8_t get(sp::Vector2i position) const
+    {
+        unsigned int x = unsigned((position.x >> chunk_shift) - directory_min.x);
+        unsigned int y = unsigned((position.y >> chunk_shift) - directory_min.y);
+        if (x >= unsigned(directory_size.x) || y >= unsigned(directory_size.y))
+            return 0;
+        return chunks[directory[x + y * directory_size.x]][(position.x & chunk_mask) | ((position.y & chunk_mask) << chunk_shift)];
+    }
+
+    bool has(sp::Vector2i position, uint8_t flags) const
+    {
+        return get(position) & flags;
+    }
+
+    void add(sp::Vector2i position, uint8_t flags)
+    {
+        sp::Vector2i chunk{position.x >> chunk_shift, position.y >> chunk_shift};
+        grow(chunk);
+        auto& index = directory[(chunk.x - directory_min.x) + (chunk.y - directory_min.y) * directory_size.x];
+        if (index == 0) {
+            index = chunks.size();
+            chunks.emplace_back();
+            chunks.back().fill(0);
+        }
+        chunks[index][(position.x & chunk_mask) | ((position.y & chunk_mask) << chunk_shift)] |= flags;
+    }
+
+private:
+    static constexpr int chunk_shift = 4;
+    static constexpr int chunk_mask = (1 << chunk_shift) - 1;
+
+    void grow(sp::Vector2i chunk)
+    {
+        if (directory_size.x > 0 && chunk.x >= directory_min.x && chunk.y >= directory_min.y
+            && chunk.x < directory_min.x + directory_size.x && chunk.y < directory_min.y + directory_size.y)
+            return;
+        sp::Vector2i new_min = chunk;
+        sp::Vector2i new_max = chunk;
+        if (directory_size.x > 0) {
+            new_min = {std::min(new_min.x, directory_min.x), std::min(new_min.y, directory_min.y)};
+            new_max = {std::max(new_max.x, directory_min.x + directory_size.x - 1), std::max(new_max.y, directory_min.y + directory_size.y - 1)};
+        }
+        sp::Vector2i new_size = new_max - new_min + sp::Vector2i(1, 1);
+        std::vector<uint32_t> new_directory(new_size.x * new_size.y, 0);
+        for(int y=0; y<directory_size.y; y++)
+            for(int x=0; x<directory_size.x; x++)
+                new_directory[(x + directory_min.x - new_min.x) + (y + directory_min.y - new_min.y) * new_size.x] = directory[x + y * directory_size.x];
+        directory = std::move(new_directory);
+        directory_min = new_min;
+        directory_size = new_size;
+    }
+
+    std::vector<std::array<uint8_t, (1 << chunk_shift) * (1 << chunk_shift)>> chunks;
+    std::vector<uint32_t> directory;
+    sp::Vector2i directory_min;
+    sp::Vector2i directory_size;
+};
+
+#endif//TILE_FLAGS_H
@@ -0,0 +1,177 @@
+#ifndef TRIGGER_GRID_H
+#define TRIGGER_GRID_H
+
+#include <sp2/scene/node.h>
+#include <sp2/math/rect.h>
+#include <unordered_map>
+#include <optional>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+//Receives the events of an area in a TriggerGrid.
+class TriggerListener
+{
+public:
+    virtual ~TriggerListener() {}
+
+    virtual void onTriggerEnter() {}
+    //Sent on every update while the position is inside the area, including the update it entered.
+    virtual void onTriggerStay() {}
+    virtual void onTriggerExit() {}
+};
+
+//Areas that react to the player being inside of them. Areas are bucketed in a grid of cells they overlap,
+//so an update only tests the areas in the cell of the player, no matter how many areas the level has.
+//Like the save participants of the world, areas of destroyed nodes are dropped the next time they are found.
+class TriggerGrid
+{
+public:
+    template<typename T> void add(T* trigger, sp::Rect2d area)
+    {
+        insert({trigger, trigger, area, {}, 0.0});
+    }
+
+    template<typename T> void add(T* trigger, sp::Vector2d center, double radius)
+    {
+        insert({trigger, trigger, sp::Rect2d(center - sp::Vector2d(radius, radius), sp::Vector2d(radius, radius) * 2.0), center, radius});
+    }
+
+    //Send the events for the new position of the player. Without a player every area it was inside gets an exit.
+    void update(std::optional<sp::Vector2d> position)
+    {
+        next_inside.clear();
+        if (position) {
+            auto it = cells.find(cellKey(cellOf(*position)));
+            if (it != cells.end()) {
+                auto& cell = it->second;
+                for(size_t n=0; n<cell.size(); ) {
+                    int index = cell[n];
+                    if (!areas[index].node) {
+                        remove(index); //replaces cell[n] with the last entry of the cell
+                        continue;
+                    }
+                    if (areas[index].contains(*position)) {
+                        areas[index].next_inside = true;
+                        next_inside.push_back(index);
+                    }
+                    n++;
+                }
+            }
+        }
+
+        for(int index : inside) {
+            auto& area = areas[index];
+            if (area.next_inside)
+                continue;
+            area.inside = false;
+            if (area.node)
+                area.listener->onTriggerExit();
+        }
+        for(int index : next_inside) {
+            auto& area = areas[index];
+            area.next_inside = false;
+            if (!area.inside) {
+                area.inside = true;
+                if (area.node)
+                    area.listener->onTriggerEnter();
+            }
+        }
+        inside.swap(next_inside);
+        for(int index : inside) {
+            if (areas[index].node)
+                areas[index].listener->onTriggerStay();
+        }
+    }
+
+    size_t size() const { return areas.size() - free_areas.size(); }
+
+private:
+    static constexpr double cell_size = 8.0;
+
+    struct Area {
+        sp::P<sp::Node> node;
+        TriggerListener* listener;
+        sp::Rect2d bounds;
+        sp::Vector2d center;
+        double radius; //0 for a rectangle area
+        bool inside = false;
+        bool next_inside = false;
+
+        bool contains(sp::Vector2d position) const
+        {
+            if (radius > 0.0)
+                return (position - center).length() <= radius;
+            return bounds.contains(position);
+        }
+    };
+
+    static sp::Vector2i cellOf(sp::Vector2d position)
+    {
+        return {int(std::floor(position.x / cell_size)), int(std::floor(position.y / cell_size))};
+    }
+
+    static uint64_t cellKey(sp::Vector2i cell)
+    {
+        return (uint64_t(uint32_t(cell.x)) << 32) | uint64_t(uint32_t(cell.y));
+    }
+
+    template<typename F> static void forEachCell(const sp::Rect2d& bounds, F f)
+    {
+        auto min = cellOf(bounds.position);
+        auto max = cellOf(bounds.position + bounds.size);
+        for(int y=min.y; y<=max.y; y++)
+            for(int x=min.x; x<=max.x; x++)
+                f(cellKey({x, y}));
+    }
+
+    void insert(Area area)
+    {
+        //Streamed triggers are added every time their chunk loads, so clean up before the list grows.
+        if (free_areas.empty() && areas.size() == areas.capacity())
+            removeDestroyed();
+        int index;
+        if (free_areas.empty()) {
+            index = int(areas.size());
+            areas.push_back(area);
+        } else {
+            index = free_areas.back();
+            free_areas.pop_back();
+            areas[index] = area;
+        }
+        forEachCell(area.bounds, [this, index](uint64_t key) { cells[key].push_back(index); });
+    }
+
+    void remove(int index)
+    {
+        auto& area = areas[index];
+        forEachCell(area.bounds, [this, index](uint64_t key) {
+            auto& cell = cells[key];
+            auto it = std::find(cell.begin(), cell.end(), index);
+            *it = cell.back();
+            cell.pop_back();
+        });
+        if (area.inside)
+            inside.erase(std::find(inside.begin(), inside.end(), index));
+        area = Area{nullptr, nullptr, {}, {}, 0.0};
+        free_areas.push_back(index);
+    }
+
+    void removeDestroyed()
+    {
+        for(size_t n=0; n<areas.size(); n++) {
+            if (areas[n].listener && !areas[n].node)
+                remove(int(n));
+        }
+    }
+
+    std::vector<Area> areas;
+    std::vector<int> free_areas;
+    std::unordered_map<uint64_t, std::vector<int>> cells;
+    std::vector<int> inside;
+    std::vector<int> next_inside;
+};
+
+#endif//TRIGGER_GRID_H
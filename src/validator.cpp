@@ -0,0 +1,116 @@
+#include "validator.h"
+
+#include <sp2/logging.h>
+#include <sp2/io/filesystem.h>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+#include <cerrno>
+extern char** environ;
+#endif
+
+
+static std::vector<sp::string> findReplays(const std::vector<sp::string>& inputs)
+{
+    std::vector<sp::string> result;
+    for(auto& input : inputs) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(input.c_str(), ec)) {
+            std::vector<sp::string> found;
+            for(auto& entry : std::filesystem::directory_iterator(input.c_str(), ec)) {
+                if (entry.is_regular_file())
+                    found.push_back(entry.path().string());
+            }
+            std::sort(found.begin(), found.end());
+            result.insert(result.end(), found.begin(), found.end());
+        } else {
+            result.push_back(input);
+        }
+    }
+    return result;
+}
+
+//Run the executable with the given arguments, without a shell in between, and wait till it ends.
+//Returns the exit code, or -1 when it could not be started or did not exit normally.
+static int runProcess(const std::vector<sp::string>& args)
+{
+#ifdef _WIN32
+    LOG(Error, "Running worker processes is not supported on this platform");
+    return -1;
+#else
+    std::vector<char*> argv;
+    for(auto& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+    if (error != 0) {
+        LOG(Error, "Failed to start", args[0], strerror(error));
+        return -1;
+    }
+    int status;
+    while(waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -1;
+    }
+    if (!WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+#endif
+}
+
+int validateReplays(const sp::string& executable, const std::vector<sp::string>& inputs, const sp::string& report_filename, int jobs)
+{
+    auto replays = findReplays(inputs);
+    if (jobs < 1)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    LOG(Info, "Validating", replays.size(), "replays with", jobs, "jobs");
+
+    std::vector<int> exit_codes(replays.size(), -1);
+    std::atomic<size_t> next_index{0};
+    std::vector<std::thread> workers;
+    for(int n=0; n<jobs; n++) {
+        workers.emplace_back([&]() {
+            while(true) {
+                size_t index = next_index++;
+                if (index >= replays.size())
+                    break;
+                auto result_filename = report_filename + ".run" + std::to_string(index);
+                exit_codes[index] = runProcess({executable, "--headless", "--replay", replays[index], "--result", result_filename});
+            }
+        });
+    }
+    for(auto& worker : workers)
+        worker.join();
+
+    nlohmann::json report;
+    report["runs"] = nlohmann::json::array();
+    int valid_count = 0;
+    for(size_t index=0; index<replays.size(); index++) {
+        auto result_filename = report_filename + ".run" + std::to_string(index);
+        auto result = nlohmann::json::parse(sp::io::loadFileContents(result_filename), nullptr, false);
+        std::remove(result_filename.c_str());
+        if (result.is_discarded() || !result.is_object())
+            result = {{"reason", "crashed"}};
+        result["replay"] = replays[index];
+        result["exit_code"] = exit_codes[index];
+        if (result.value("reason", "") == "ending")
+            valid_count++;
+        report["runs"].push_back(result);
+    }
+    report["total"] = replays.size();
+    report["reached_ending"] = valid_count;
+    if (!sp::io::saveFileContents(report_filename, report.dump(2))) {
+        LOG(Error, "Failed to write report", report_filename);
+        return 1;
+    }
+    LOG(Info, valid_count, "of", replays.size(), "replays reached an ending, report written to", report_filename);
+    return valid_count == int(replays.size()) ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include <sp2/string.h>
+#include <vector>
+
+
+//Validates a batch of recorded runs by simulating each of them in a headless instance of the game.
+//A world cannot be stepped on its own thread, the engine steps all scenes from its single loop and its resource caches
+//and pointer bookkeeping are not thread safe. So every run is a worker process of its own, started without a shell,
+//and `jobs` of them run at the same time, by default one per core.
+//Inputs can be replay files or directories containing them, results for all runs are written as json to report_filename.
+//Returns 0 only when every run reached an ending.
+int validateReplays(const sp::string& executable, const std::vector<sp::string>& inputs, const sp::string& report_filename, int jobs);
+
+#endif//VALIDATOR_H